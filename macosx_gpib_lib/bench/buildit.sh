@@ -0,0 +1,4 @@
+LIBDIR=../macosx_gpib_lib
+LIBSRC=`ls ${LIBDIR}/*.m ${LIBDIR}/*.c | grep -v gpibinter.c`
+gcc -o gpib_bench -DGPIB_PROFILE -fPIC -framework Foundation -framework IOKit -include ../macosx_gpib_Prefix.pch -I${LIBDIR} gpib_bench.m ${LIBSRC}
+gcc -o gpib_eos_bench -O2 -I${LIBDIR} gpib_eos_bench.c ${LIBDIR}/gpib_eos.c ${LIBDIR}/gpib_profile.c
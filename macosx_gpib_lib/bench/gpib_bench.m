@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * Benchmark of the library through its public C API.
+ *
+ * Measures the round trip latency of short queries, of command writes and
+ * of SRQ handling (ibwait + ibrsp), and the throughput of ibwrt/ibrd for
+ * transfer sizes from 1 byte to 16 MB.  With a library built with
+ * -DGPIB_PROFILE the time of each call is split between the upper layers
+ * (cinterface, gpib_visa, gpib_visa_internal), the gpib_link thread hop,
+ * gpib_sys and the gpib_board driver.
+ * The heap allocations made by the process during each call are counted
+ * through the malloc_logger hook.
+ * Results are written as JSON.
+ *
+ * usage: gpib_bench [-b sim|82357] [-n iterations] [-M max_size]
+ *                   [-l latency_usec] [-q pad] [-d pad] [-s pad]
+ *                   [-c read_query] [-o file]
+ */
+
+#import <getopt.h>
+#import <stdatomic.h>
+#import <stdio.h>
+#import <stdlib.h>
+#import <string.h>
+#import "ib.h"
+#import "gpib_sim_board.h"
+#import "gpib_profile.h"
+
+#define BENCH_BOARD 0
+#define BENCH_TIMEOUT T3s
+#define BENCH_BYTES_PER_SIZE ( 64 << 20 )
+
+typedef struct
+{
+    const char *backend;
+    int iterations;
+    long max_size;
+    unsigned int latency_usec;
+    int query_pad;
+    int data_pad;
+    int srq_pad;
+    const char *read_query;
+    FILE *out;
+} bench_options;
+
+/* called by libmalloc for every allocation and free when set, this is
+ * the hook the allocation instruments use */
+typedef void ( bench_malloc_logger_t )( uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
+    uintptr_t result, uint32_t num_hot_frames_to_skip );
+extern bench_malloc_logger_t *malloc_logger;
+#define BENCH_MALLOC_LOG_TYPE_ALLOCATE 2
+
+static atomic_ullong allocations;
+
+static void count_allocation( uint32_t type, uintptr_t arg1, uintptr_t arg2, uintptr_t arg3,
+    uintptr_t result, uint32_t num_hot_frames_to_skip )
+{
+    if( type & BENCH_MALLOC_LOG_TYPE_ALLOCATE )
+        atomic_fetch_add_explicit( &allocations, 1, memory_order_relaxed );
+}
+
+typedef struct
+{
+    uint64_t *samples;
+    int count;
+    uint64_t start_allocations;
+    uint64_t start_nsec[ GPIB_PROFILE_NUM_LAYERS ];
+    uint64_t start_calls[ GPIB_PROFILE_NUM_LAYERS ];
+} bench_run;
+
+static gpib_sim_instrument *data_instrument = nil;
+static int first_result = 1;
+
+static void add_instruments( const bench_options *options )
+{
+    gpib_sim_instrument *instrument;
+
+    /* answers *IDN? */
+    instrument = [[gpib_sim_instrument alloc] init_gpib_sim_instrument:options->query_pad : -1];
+    [instrument setLatencyUsec:options->latency_usec];
+    [instrument setResponse:[NSData dataWithBytes:"SIMULATED,GPIB,0,1.0\n" length:21]];
+    [gpib_sim_board add_instrument:instrument];
+    /* sink for the writes, block source for the reads */
+    data_instrument = [[gpib_sim_instrument alloc] init_gpib_sim_instrument:options->data_pad : -1];
+    [data_instrument setLatencyUsec:options->latency_usec];
+    [data_instrument setBlockLength:1];
+    [gpib_sim_board add_instrument:data_instrument];
+    /* requests service when a query has been answered */
+    instrument = [[gpib_sim_instrument alloc] init_gpib_sim_instrument:options->srq_pad : -1];
+    [instrument setLatencyUsec:options->latency_usec];
+    [instrument setResponse:[NSData dataWithBytes:"1\n" length:2]];
+    [instrument setSrqOnMessage:YES];
+    [gpib_sim_board add_instrument:instrument];
+}
+
+static int compare_samples( const void *a, const void *b )
+{
+    uint64_t x = *( const uint64_t * ) a;
+    uint64_t y = *( const uint64_t * ) b;
+
+    if( x < y ) return -1;
+    if( x > y ) return 1;
+    return 0;
+}
+
+static double percentile_usec( const bench_run *run, double fraction )
+{
+    int index;
+
+    if( run->count == 0 ) return 0.0;
+    index = ( int )( fraction * ( run->count - 1 ) + 0.5 );
+    return run->samples[ index ] / 1000.0;
+}
+
+static void run_start( bench_run *run, int iterations )
+{
+    run->samples = calloc( iterations, sizeof( uint64_t ) );
+    run->count = 0;
+    gpib_profile_read( run->start_nsec, run->start_calls );
+    run->start_allocations = atomic_load( &allocations );
+}
+
+/* prints the statistics of a run, 'bytes' is the total amount of data
+ * transferred or 0 for the latency tests */
+static void run_report( const bench_options *options, bench_run *run, const char *test, long size, double bytes, int errors )
+{
+    uint64_t nsec[ GPIB_PROFILE_NUM_LAYERS ], calls[ GPIB_PROFILE_NUM_LAYERS ];
+    double total = 0.0, layer[ GPIB_PROFILE_NUM_LAYERS ];
+    FILE *out = options->out;
+    uint64_t allocated = atomic_load( &allocations ) - run->start_allocations;
+    int i;
+
+    gpib_profile_read( nsec, calls );
+    for( i = 0; i < run->count; i++ )
+        total += run->samples[ i ];
+    for( i = 0; i < GPIB_PROFILE_NUM_LAYERS; i++ )
+        layer[ i ] = run->count ? ( nsec[ i ] - run->start_nsec[ i ] ) / 1000.0 / run->count : 0.0;
+    qsort( run->samples, run->count, sizeof( uint64_t ), compare_samples );
+
+    fprintf( out, "%s    {\"test\": \"%s\", \"size\": %ld, \"iterations\": %d, \"errors\": %d,\n",
+        first_result ? "" : ",\n", test, size, run->count, errors );
+    first_result = 0;
+    fprintf( out, "     \"mean_us\": %.3f, \"p50_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f",
+        run->count ? total / 1000.0 / run->count : 0.0,
+        percentile_usec( run, 0.5 ), percentile_usec( run, 0.99 ), percentile_usec( run, 0.999 ) );
+    if( bytes > 0.0 )
+        fprintf( out, ", \"mb_per_s\": %.3f", total > 0.0 ? bytes / ( total / 1e9 ) / 1e6 : 0.0 );
+    fprintf( out, ", \"allocs_per_call\": %.2f", run->count ? ( double ) allocated / run->count : 0.0 );
+    if( gpib_profile_enabled() && run->count )
+    {
+        double mean = total / 1000.0 / run->count;
+        fprintf( out, ",\n     \"layers_us\": {\"visa\": %.3f, \"link_hop\": %.3f, \"sys\": %.3f, \"board\": %.3f},"
+            " \"ioctls_per_call\": %.2f",
+            mean - layer[ GPIB_PROFILE_LINK ],
+            layer[ GPIB_PROFILE_LINK ] - layer[ GPIB_PROFILE_IOCTL ],
+            layer[ GPIB_PROFILE_IOCTL ] - layer[ GPIB_PROFILE_BOARD ],
+            layer[ GPIB_PROFILE_BOARD ],
+            ( double )( calls[ GPIB_PROFILE_LINK ] - run->start_calls[ GPIB_PROFILE_LINK ] ) / run->count );
+    }
+    fprintf( out, "}" );
+    free( run->samples );
+    run->samples = NULL;
+}
+
+static void bench_query( const bench_options *options, int ud )
+{
+    bench_run run;
+    char buffer[ 256 ];
+    uint64_t start;
+    int i, errors = 0;
+
+    run_start( &run, options->iterations );
+    for( i = 0; i < options->iterations; i++ )
+    {
+        start = gpib_profile_clock();
+        ibwrt( ud, "*IDN?\n", 6 );
+        if( ( ibsta & ERR ) == 0 )
+            ibrd( ud, buffer, sizeof( buffer ) );
+        run.samples[ run.count++ ] = gpib_profile_clock() - start;
+        if( ibsta & ERR ) errors++;
+    }
+    run_report( options, &run, "query", 6, 0.0, errors );
+}
+
+static void bench_command( const bench_options *options )
+{
+    static const unsigned char commands[] = { UNT, UNL };
+    bench_run run;
+    uint64_t start;
+    int i, errors = 0;
+
+    run_start( &run, options->iterations );
+    for( i = 0; i < options->iterations; i++ )
+    {
+        start = gpib_profile_clock();
+        ibcmd( BENCH_BOARD, commands, sizeof( commands ) );
+        run.samples[ run.count++ ] = gpib_profile_clock() - start;
+        if( ibsta & ERR ) errors++;
+    }
+    run_report( options, &run, "command", sizeof( commands ), 0.0, errors );
+}
+
+static void bench_srq( const bench_options *options, int ud )
+{
+    bench_run run;
+    char buffer[ 64 ];
+    char status_byte;
+    uint64_t start;
+    int i, errors = 0;
+
+    run_start( &run, options->iterations );
+    for( i = 0; i < options->iterations; i++ )
+    {
+        start = gpib_profile_clock();
+        ibwrt( ud, "*OPC?\n", 6 );
+        ibwait( BENCH_BOARD, SRQI | TIMO );
+        if( ibsta & TIMO ) errors++;
+        ibrsp( ud, &status_byte );
+        ibrd( ud, buffer, sizeof( buffer ) );
+        run.samples[ run.count++ ] = gpib_profile_clock() - start;
+        if( ibsta & ERR ) errors++;
+    }
+    run_report( options, &run, "srq", 6, 0.0, errors );
+}
+
+static int size_iterations( const bench_options *options, long size )
+{
+    long iterations = BENCH_BYTES_PER_SIZE / size;
+
+    if( iterations > options->iterations ) iterations = options->iterations;
+    if( iterations < 3 ) iterations = 3;
+    return ( int ) iterations;
+}
+
+static void bench_write( const bench_options *options, int ud, unsigned char *buffer )
+{
+    bench_run run;
+    uint64_t start;
+    double bytes;
+    long size;
+    int i, iterations, errors;
+
+    for( size = 1; size <= options->max_size; size *= 16 )
+    {
+        iterations = size_iterations( options, size );
+        errors = 0;
+        bytes = 0.0;
+        run_start( &run, iterations );
+        for( i = 0; i < iterations; i++ )
+        {
+            start = gpib_profile_clock();
+            ibwrt( ud, buffer, size );
+            run.samples[ run.count++ ] = gpib_profile_clock() - start;
+            if( ibsta & ERR ) errors++;
+            bytes += ibcntl;
+        }
+        run_report( options, &run, "write", size, bytes, errors );
+    }
+}
+
+static void bench_read( const bench_options *options, int ud, unsigned char *buffer )
+{
+    bench_run run;
+    uint64_t start;
+    double bytes;
+    long size, length;
+    int i, iterations, errors;
+
+    for( size = 1; size <= options->max_size; size *= 16 )
+    {
+        /* the bus is idle between two calls, the instrument can be changed */
+        [data_instrument setBlockLength:size];
+        iterations = size_iterations( options, size );
+        errors = 0;
+        bytes = 0.0;
+        /* block header and trailing newline */
+        length = size + 16;
+        run_start( &run, iterations );
+        for( i = 0; i < iterations; i++ )
+        {
+            ibwrt( ud, options->read_query, strlen( options->read_query ) );
+            start = gpib_profile_clock();
+            ibrd( ud, buffer, length );
+            run.samples[ run.count++ ] = gpib_profile_clock() - start;
+            if( ibsta & ERR ) errors++;
+            bytes += ibcntl;
+        }
+        run_report( options, &run, "read", size, bytes, errors );
+    }
+}
+
+static void usage( const char *name )
+{
+    fprintf( stderr, "usage: %s [-b sim|82357] [-n iterations] [-M max_size] [-l latency_usec]\n"
+        "\t[-q query_pad] [-d data_pad] [-s srq_pad] [-c read_query] [-o file]\n", name );
+    exit( 1 );
+}
+
+int main( int argc, char *argv[] )
+{
+    bench_options options = { "sim", 1000, 16 << 20, 0, 1, 2, 3, "DATA?\n", stdout };
+    unsigned char *buffer;
+    int query_ud, data_ud, srq_ud;
+    int c;
+
+    while( ( c = getopt( argc, argv, "b:n:M:l:q:d:s:c:o:" ) ) != -1 )
+    {
+        switch( c )
+        {
+        case 'b': options.backend = optarg; break;
+        case 'n': options.iterations = atoi( optarg ); break;
+        case 'M': options.max_size = atol( optarg ); break;
+        case 'l': options.latency_usec = atoi( optarg ); break;
+        case 'q': options.query_pad = atoi( optarg ); break;
+        case 'd': options.data_pad = atoi( optarg ); break;
+        case 's': options.srq_pad = atoi( optarg ); break;
+        case 'c': options.read_query = optarg; break;
+        case 'o':
+            options.out = fopen( optarg, "w" );
+            if( options.out == NULL )
+            {
+                perror( optarg );
+                return 1;
+            }
+            break;
+        default: usage( argv[ 0 ] );
+        }
+    }
+    if( options.iterations < 1 || options.max_size < 1 ) usage( argv[ 0 ] );
+
+    @autoreleasepool
+    {
+        /* the board class has to be chosen before the first library call */
+        if( strcmp( options.backend, "sim" ) == 0 )
+        {
+            setenv( "GPIB_BOARD_CLASS", "gpib_sim_board", 1 );
+            add_instruments( &options );
+        }
+        else if( strcmp( options.backend, "82357" ) == 0 )
+            setenv( "GPIB_BOARD_CLASS", "agilent_82357_ab", 1 );
+        else
+            usage( argv[ 0 ] );
+
+        query_ud = ibdev( BENCH_BOARD, options.query_pad, 0, BENCH_TIMEOUT, 1, 0 );
+        data_ud = ibdev( BENCH_BOARD, options.data_pad, 0, BENCH_TIMEOUT, 1, 0 );
+        srq_ud = ibdev( BENCH_BOARD, options.srq_pad, 0, BENCH_TIMEOUT, 1, 0 );
+        if( query_ud < 0 || data_ud < 0 || srq_ud < 0 )
+        {
+            fprintf( stderr, "gpib_bench: ibdev failed, iberr=%d\n", iberr );
+            return 1;
+        }
+        buffer = malloc( options.max_size + 16 );
+        if( buffer == NULL )
+        {
+            perror( "gpib_bench" );
+            return 1;
+        }
+        memset( buffer, 'A', options.max_size + 16 );
+        malloc_logger = count_allocation;
+
+        fprintf( options.out, "{\"backend\": \"%s\", \"profile\": %s, \"results\": [\n",
+            options.backend, gpib_profile_enabled() ? "true" : "false" );
+        bench_query( &options, query_ud );
+        bench_command( &options );
+        if( strcmp( options.backend, "sim" ) == 0 )
+            bench_srq( &options, srq_ud );
+        bench_write( &options, data_ud, buffer );
+        bench_read( &options, data_ud, buffer );
+        fprintf( options.out, "\n]}\n" );
+        malloc_logger = NULL;
+
+        ibonl( query_ud, 0 );
+        ibonl( data_ud, 0 );
+        ibonl( srq_ud, 0 );
+        free( buffer );
+    }
+    if( options.out != stdout ) fclose( options.out );
+    return 0;
+}
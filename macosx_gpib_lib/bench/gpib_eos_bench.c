@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+/*
+ * Microbenchmark of the EOS search used by XEOS writes and host side read
+ * termination (gpib_find_eos) against a byte at a time loop.
+ *
+ * Each buffer size from 1 KB to 64 MB is searched for an EOS character it
+ * doesn't contain, which is the cost of scanning a whole write, with the
+ * 8 bit and the 7 bit (BIN clear) compares.  Results are written as JSON.
+ *
+ * usage: gpib_eos_bench [-M max_size] [-o file]
+ */
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gpib_eos.h"
+#include "gpib_profile.h"
+
+#define EOS_BENCH_MIN_SIZE 1024
+#define EOS_BENCH_BYTES_PER_SIZE ( 256 << 20 )
+#define EOS_BENCH_EOS '\n'
+
+static ssize_t find_eos_bytewise( const uint8_t *buffer, size_t length, uint8_t eos, int compare_8_bits )
+{
+    uint8_t compare_mask = compare_8_bits ? 0xff : 0x7f;
+    size_t i;
+
+    for( i = 0; i < length; i++ )
+    {
+        if( ( buffer[ i ] & compare_mask ) == ( eos & compare_mask ) )
+            return i;
+    }
+    return -1;
+}
+
+typedef ssize_t ( eos_search_t )( const uint8_t *, size_t, uint8_t, int );
+
+static int first_result = 1;
+
+static void bench_search( FILE *out, const char *name, eos_search_t *search, const uint8_t *buffer,
+    size_t size, int compare_8_bits )
+{
+    uint64_t start, elapsed;
+    long iterations, i;
+    int errors = 0;
+
+    iterations = EOS_BENCH_BYTES_PER_SIZE / size;
+    if( iterations < 3 ) iterations = 3;
+
+    start = gpib_profile_clock();
+    for( i = 0; i < iterations; i++ )
+    {
+        if( search( buffer, size, EOS_BENCH_EOS, compare_8_bits ) != -1 )
+            errors++;
+    }
+    elapsed = gpib_profile_clock() - start;
+
+    fprintf( out, "%s    {\"test\": \"%s\", \"compare\": %d, \"size\": %zu, \"iterations\": %ld, \"errors\": %d,"
+        " \"mean_us\": %.3f, \"mb_per_s\": %.1f}",
+        first_result ? "" : ",\n", name, compare_8_bits ? 8 : 7, size, iterations, errors,
+        elapsed / 1000.0 / iterations, elapsed ? ( double ) size * iterations / ( elapsed / 1e9 ) / 1e6 : 0.0 );
+    first_result = 0;
+}
+
+static void usage( const char *name )
+{
+    fprintf( stderr, "usage: %s [-M max_size] [-o file]\n", name );
+    exit( 1 );
+}
+
+int main( int argc, char *argv[] )
+{
+    long max_size = 64 << 20;
+    FILE *out = stdout;
+    uint8_t *buffer;
+    size_t size, i;
+    int compare_8_bits;
+    int c;
+
+    while( ( c = getopt( argc, argv, "M:o:" ) ) != -1 )
+    {
+        switch( c )
+        {
+        case 'M': max_size = atol( optarg ); break;
+        case 'o':
+            out = fopen( optarg, "w" );
+            if( out == NULL )
+            {
+                perror( optarg );
+                return 1;
+            }
+            break;
+        default: usage( argv[ 0 ] );
+        }
+    }
+    if( max_size < EOS_BENCH_MIN_SIZE )
+        usage( argv[ 0 ] );
+
+    buffer = malloc( max_size );
+    if( buffer == NULL )
+    {
+        perror( "malloc" );
+        return 1;
+    }
+    /* random data without the EOS character, even with its high bit set */
+    srandom( 1 );
+    for( i = 0; i < ( size_t ) max_size; i++ )
+    {
+        do
+            buffer[ i ] = random();
+        while( ( buffer[ i ] & 0x7f ) == EOS_BENCH_EOS );
+    }
+
+    fprintf( out, "{\"results\": [\n" );
+    for( size = EOS_BENCH_MIN_SIZE; size <= ( size_t ) max_size; size *= 4 )
+    {
+        for( compare_8_bits = 0; compare_8_bits < 2; compare_8_bits++ )
+        {
+            bench_search( out, "bytewise", find_eos_bytewise, buffer, size, compare_8_bits );
+            bench_search( out, "gpib_find_eos", gpib_find_eos, buffer, size, compare_8_bits );
+        }
+    }
+    fprintf( out, "\n]}\n" );
+
+    free( buffer );
+    if( out != stdout )
+        fclose( out );
+    return 0;
+}
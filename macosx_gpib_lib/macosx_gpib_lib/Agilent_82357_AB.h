@@ -148,6 +148,14 @@ enum xfer_abort_type
     XA_FLUSH = 0x1
 };
 
+/* ATN as the driver last left it */
+enum agilent_82357_atn_states
+{
+    ATN_STATE_UNKNOWN = 0,
+    ATN_STATE_ASSERTED,
+    ATN_STATE_RELEASED
+};
+
 typedef struct {
     BOOL timed_out;
     IOReturn result;
@@ -166,6 +174,7 @@ typedef struct
     UInt32 bulk_in_endpoint;
     UInt32 interrupt_in_endpoint;
     UInt16 maxInOutPacketSize;
+    UInt16 bulkInPacketSize;
     UInt16 maxInterruptPacketSize;
     BOOL triggered;
     private_board *board;
@@ -177,6 +186,33 @@ struct register_pairlet
     unsigned short value;
 };
 
+/* register accesses a single DATA_PIPE_CMD_WR_REGS or RD_REGS carries */
+#define AGILENT_82357_MAX_REGISTER_WRITES 31
+#define AGILENT_82357_MAX_REGISTER_READS 62
+/* bulk messages a register batch can be split in */
+#define AGILENT_82357_MAX_REGISTER_MESSAGES 4
+
+/* one DATA_PIPE_CMD_WR_REGS or DATA_PIPE_CMD_RD_REGS and its answer */
+typedef struct
+{
+    UInt8 command;
+    UInt32 count;
+    struct register_pairlet *reads[AGILENT_82357_MAX_REGISTER_READS];
+    UInt8 out_data[AGILENT_82357_MAX_REGISTER_READS + 2];
+    UInt8 in_data[AGILENT_82357_MAX_REGISTER_READS + 2];
+    bulk_context out_context;
+    bulk_context in_context;
+} register_message;
+
+/* register reads and writes queued with batch_write/batch_read and sent by
+ * batch_flush, consecutive accesses of the same kind share a message */
+typedef struct
+{
+    register_message messages[AGILENT_82357_MAX_REGISTER_MESSAGES];
+    UInt32 num_messages;
+    BOOL overflow;
+} register_batch;
+
 enum firmware_registers
 {
     HW_CONTROL = 0xa,
@@ -215,6 +251,16 @@ enum protocol_control_bits
 };
 
 static const UInt16 control_request = 0x4;
+/* largest read the firmware is asked for at once */
+static const UInt32 agilent_82357_max_read_length = 0x40000;
+/* bulk in transfer size of a pipelined read */
+static const UInt32 agilent_82357_read_chunk_length = 0x4000;
+/* bulk in transfers kept queued during a pipelined read */
+#define AGILENT_82357_READS_IN_FLIGHT 3
+/* largest write sent straight from the caller's buffer at once */
+static const UInt32 agilent_82357_max_write_length = 0x40000;
+/* largest bulk in packet a read can go straight to the caller's buffer with */
+#define AGILENT_82357_MAX_PACKET 0x200
 
 /*! \category agilent_82357_ab(gpib_board)
     \abstract A category on gpib_board
@@ -231,6 +277,14 @@ static const UInt16 control_request = 0x4;
     pthread_mutex_t m_bulk_alloc_lock;
     pthread_mutex_t m_interrupt_alloc_lock;
     pthread_mutex_t m_control_alloc_lock;
+    /* shadow of the controller state, lets take_control, go_to_standby and
+     * request_system_control skip writes that would change nothing */
+    SInt8 m_atn_state;
+    unsigned short m_hw_control_written;
+    BOOL m_hw_control_valid;
+    /* ADSR as last read, kept up to date through our own bus operations */
+    unsigned short m_adsr;
+    BOOL m_adsr_valid;
     BOOL m_is_cic : YES;
 }
 
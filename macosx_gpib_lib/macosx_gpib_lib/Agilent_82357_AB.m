@@ -43,6 +43,16 @@ static void bulk_complete(void * refCon, IOReturn result, void * arg0)
     CFRunLoopWakeUp(context->runner);
 }
 
+static void bulk_context_prepare(bulk_context *context, CFRunLoopSourceContext *source_context, BOOL triggered)
+{
+    context->runner = CFRunLoopGetCurrent();
+    context->complete = CFRunLoopSourceCreate(NULL, 0, source_context);
+    context->timed_out = NO;
+    context->actual_length = 0;
+    context->result = 0;
+    context->triggered = triggered;
+}
+
 /*
  * \brief  Callback function for Interrupt
  *
@@ -77,9 +87,7 @@ static void interrupt_complete(void * refCon, IOReturn result, void * arg0)
        GPIB_DPRINTK("%s: failed to resubmit interrupt urb\n", __FUNCTION__);
     a_priv->triggered = YES;
     
-    CFRunLoopSourceSignal(a_priv->board->wait);
-    /*CFRunLoopWakeUp(context->runner) is optional but recommendend with CFRunLoopSourceSignal version 0 */
-    CFRunLoopWakeUp(a_priv->board->runner);
+    gpib_wake_board(a_priv->board);
 }
 
 @implementation agilent_82357_ab
@@ -245,162 +253,202 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     GPIB_DPRINTK("\n");
 }
 
--(SInt32) write_registers:(const struct register_pairlet *) writes : (UInt32) num_writes
+-(void) batch_init:(register_batch *) batch
 {
-    SInt32 retval;
-    UInt8 *out_data, *in_data;
-    UInt32 out_data_length, in_data_length;
-    UInt32 bytes_written, bytes_read;
-    UInt32 i = 0;
-    UInt32 j;
-    const UInt16 bytes_per_write = 2;
-    const UInt16 header_length = 2;
-    const UInt16 max_writes = 31;
+    batch->num_messages = 0;
+    batch->overflow = NO;
+}
+
+/* returns the message the next access of kind 'command' goes in */
+-(register_message *) batch_message:(register_batch *) batch : (UInt8) command
+{
+    register_message *message;
+    const UInt32 max_count = (command == DATA_PIPE_CMD_WR_REGS) ? AGILENT_82357_MAX_REGISTER_WRITES : AGILENT_82357_MAX_REGISTER_READS;
     
-    if(num_writes > max_writes)
-    {
-        GPIB_DPRINTK("%s: %s: bug! num_writes=%i too large\n", __FILE__, __FUNCTION__, num_writes);
-        return -EIO;
-    }
-    out_data_length = num_writes * bytes_per_write + header_length;
-    out_data = calloc(out_data_length,sizeof(UInt8));
-    out_data[i++] = DATA_PIPE_CMD_WR_REGS;
-    out_data[i++] = num_writes;
-    for(j = 0; j < num_writes; j++)
+    if(batch->num_messages)
     {
-        out_data[i++] = writes[j].address;
-        out_data[i++] = writes[j].value;
+        message = &batch->messages[batch->num_messages - 1];
+        if(message->command == command && message->count < max_count)
+            return message;
     }
-    if(i > out_data_length)
+    if(batch->num_messages == AGILENT_82357_MAX_REGISTER_MESSAGES)
     {
-        printf("%s: bug! buffer overrun\n", __FUNCTION__);
-    }
-    retval = pthread_mutex_lock(&m_bulk_transfer_lock);
-    if(retval)
-    {
-        free(out_data);
-        return retval;
+        GPIB_DPRINTK("%s: %s: bug! too many register messages\n", __FILE__, __FUNCTION__);
+        batch->overflow = YES;
+        return NULL;
     }
-    retval = [self send_bulk_msg: out_data : i : &bytes_written : 1000];
-    free(out_data);
-    if(retval)
-    {
-        GPIB_DPRINTK("%s: %s: send_bulk_msg returned %i, bytes_written=%i, i=%i\n", __FILE__, __FUNCTION__,
-              retval, bytes_written, i);
-        pthread_mutex_unlock(&m_bulk_transfer_lock);
-        return retval;
-    }
-    in_data_length = 0x20;
-    in_data = calloc(in_data_length, sizeof(UInt8));
-    retval = [self receive_bulk_msg:in_data : in_data_length : &bytes_read : 1000];
-    pthread_mutex_unlock(&m_bulk_transfer_lock);
-    if(retval)
-    {
-        GPIB_DPRINTK("%s: %s: receive_bulk_msg returned %i, bytes_read=%i\n", __FILE__, __FUNCTION__, retval, bytes_read);
-        [self dump_raw_block:in_data : bytes_read];
-        free(in_data);
-        return -EIO;
-    }
-    if(in_data[0] != (0xff & ~DATA_PIPE_CMD_WR_REGS))
-    {
-        GPIB_DPRINTK("%s: %s: error, bulk command=0x%x != ~DATA_PIPE_CMD_WR_REGS\n", __FILE__, __FUNCTION__, in_data[0]);
-        free(in_data);
-        return -EIO;
-    }
-    if(in_data[1])
-    {
-        GPIB_DPRINTK("%s: %s: nonzero error code 0x%x in DATA_PIPE_CMD_WR_REGS response\n", __FILE__, __FUNCTION__, in_data[1]);
-        free(in_data);
-        return -EIO;
-    }
-    free(in_data);
-    return 0;
+    message = &batch->messages[batch->num_messages++];
+    message->command = command;
+    message->count = 0;
+    message->out_data[0] = command;
+    return message;
 }
 
--(SInt32) read_registers:(struct register_pairlet *) reads : (UInt32) num_reads : (BOOL) blocking
+-(void) batch_write:(register_batch *) batch : (short) address : (unsigned short) value
 {
-    SInt32 retval;
-    UInt8 *out_data, *in_data;
-    UInt32 out_data_length, in_data_length;
-    UInt32 bytes_written, bytes_read;
-    UInt32 i = 0;
-    UInt32 j;
-    const UInt32 header_length = 2;
-    const UInt32 max_reads = 62;
+    register_message *message;
     
-    if(num_reads > max_reads)
-    {
-        GPIB_DPRINTK("%s: %s: bug! num_reads=%i too large\n", __FILE__, __FUNCTION__, num_reads);
-    }
-    out_data_length = num_reads + header_length;
-    out_data = calloc(out_data_length, sizeof(UInt8));
-    out_data[i++] = DATA_PIPE_CMD_RD_REGS;
-    out_data[i++] = num_reads;
-    for(j = 0; j < num_reads; j++)
-    {
-        out_data[i++] = reads[j].address;
-    }
-    if(i > out_data_length)
-    {
-        GPIB_DPRINTK("%s: bug! buffer overrun\n", __FUNCTION__);
-    }
+    message = [self batch_message:batch : DATA_PIPE_CMD_WR_REGS];
+    if(message == NULL)
+        return;
+    message->out_data[2 + 2 * message->count] = address;
+    message->out_data[3 + 2 * message->count] = value;
+    ++message->count;
+}
+
+/* 'read->value' is set by batch_flush */
+-(void) batch_read:(register_batch *) batch : (struct register_pairlet *) read
+{
+    register_message *message;
+    
+    message = [self batch_message:batch : DATA_PIPE_CMD_RD_REGS];
+    if(message == NULL)
+        return;
+    message->out_data[2 + message->count] = read->address;
+    message->reads[message->count++] = read;
+}
+
+/*
+ * \brief  Sends the queued register accesses
+ *
+ * Every message and its answer are submitted at once, the adapter receives
+ * the next message while the host collects the previous answer, so a batch
+ * costs about a single round trip.  Without 'blocking' gives up with
+ * -EAGAIN when another bulk transfer is in progress.
+ */
+-(SInt32) batch_flush:(register_batch *) batch : (BOOL) blocking
+{
+    SInt32 retval = 0;
+    IOReturn kr = 0;
+    register_message *message;
+    UInt32 m, j, out_length;
+    BOOL timed_out = NO;
+    
+    if(batch->overflow)
+        return -EIO;
+    if(batch->num_messages == 0)
+        return 0;
     if(blocking)
     {
         retval = pthread_mutex_lock(&m_bulk_transfer_lock);
         if(retval)
-        {
-            free(out_data);
             return retval;
-        }
-        
-    }else
+    }else if(pthread_mutex_trylock(&m_bulk_transfer_lock))
+        return -EAGAIN;
+    pthread_mutex_lock(&m_bulk_alloc_lock);
+    if(m_private.bus_interface == NULL)
     {
-        retval = pthread_mutex_trylock(&m_bulk_transfer_lock);
-        if(retval)
+        pthread_mutex_unlock(&m_bulk_alloc_lock);
+        pthread_mutex_unlock(&m_bulk_transfer_lock);
+        return -ENODEV;
+    }
+    for(m = 0; m < batch->num_messages; m++)
+    {
+        message = &batch->messages[m];
+        message->out_data[1] = message->count;
+        out_length = 2 + message->count * ((message->command == DATA_PIPE_CMD_WR_REGS) ? 2 : 1);
+        /* transfers that are never submitted count as done */
+        bulk_context_prepare(&message->out_context, &m_source_context, kr != 0);
+        bulk_context_prepare(&message->in_context, &m_source_context, kr != 0);
+        if(kr)
+            continue;
+        kr = (*m_private.bus_interface)->WritePipeAsyncTO(m_private.bus_interface, m_private.bulk_out_endpoint, message->out_data, out_length, 1000, 1000, &bulk_complete, &message->out_context);
+        if(kr)
         {
-            free(out_data);
-            return -EAGAIN;
+            message->out_context.triggered = YES;
+            message->in_context.triggered = YES;
+            continue;
         }
+        kr = (*m_private.bus_interface)->ReadPipeAsyncTO(m_private.bus_interface, m_private.bulk_in_endpoint, message->in_data, sizeof(message->in_data), 10000, 10000, &bulk_complete, &message->in_context);
+        if(kr)
+            message->in_context.triggered = YES;
     }
-    retval = [self send_bulk_msg:out_data : i : &bytes_written : 1000];
-    free(out_data);
-    if(retval)
+    if(kr)
     {
-        GPIB_DPRINTK("%s: %s: send_bulk_msg returned %i, bytes_written=%i, i=%i\n", __FILE__, __FUNCTION__,
-              retval, bytes_written, i);
-        pthread_mutex_unlock(&m_bulk_transfer_lock);
-        return retval;
+        GPIB_DPRINTK("%s: %s: failed to submit register message, retval=%i\n", __FILE__, __FUNCTION__, kr);
+        retval = -EIO;
     }
-    in_data_length = 0x20;
-    in_data = calloc(in_data_length,sizeof(UInt8));
-    retval = [self receive_bulk_msg:in_data : in_data_length : &bytes_read : 10000];
-    pthread_mutex_unlock(&m_bulk_transfer_lock);
-    if(retval)
+    /* the transfers time out by themselves */
+    for(m = 0; m < batch->num_messages; m++)
     {
-        GPIB_DPRINTK("%s: %s: receive_bulk_msg returned %i, bytes_read=%i\n", __FILE__, __FUNCTION__, retval, bytes_read);
-        [self dump_raw_block:in_data : bytes_read];
-        free(in_data);
-        return -EIO;
+        message = &batch->messages[m];
+        while(!message->out_context.triggered || !message->in_context.triggered)
+            CFRunLoopRunInMode(kCFRunLoopDefaultMode, 1.0, YES);
+        if(message->out_context.result == kIOReturnTimeout || message->in_context.result == kIOReturnTimeout)
+            timed_out = YES;
     }
-    i = 0;
-    if(in_data[i++] != (0xff & ~DATA_PIPE_CMD_RD_REGS))
+    if(timed_out)
     {
-        GPIB_DPRINTK("%s: %s: error, bulk command=0x%x != ~DATA_PIPE_CMD_RD_REGS\n", __FILE__, __FUNCTION__, in_data[0]);
-        free(in_data);
-        return -EIO;
+        (*m_private.bus_interface)->ClearPipeStallBothEnds(m_private.bus_interface, m_private.bulk_out_endpoint);
+        (*m_private.bus_interface)->ClearPipeStallBothEnds(m_private.bus_interface, m_private.bulk_in_endpoint);
     }
-    if(in_data[i++])
+    pthread_mutex_unlock(&m_bulk_alloc_lock);
+    pthread_mutex_unlock(&m_bulk_transfer_lock);
+    
+    for(m = 0; m < batch->num_messages; m++)
     {
-        GPIB_DPRINTK("%s: %s: nonzero error code 0x%x in DATA_PIPE_CMD_RD_REGS response\n", __FILE__, __FUNCTION__, in_data[1]);
-        free(in_data);
-        return -EIO;
+        message = &batch->messages[m];
+        CFRunLoopSourceInvalidate(message->out_context.complete);
+        CFRelease(message->out_context.complete);
+        CFRunLoopSourceInvalidate(message->in_context.complete);
+        CFRelease(message->in_context.complete);
+        if(retval)
+            continue;
+        if(message->out_context.result || message->in_context.result)
+        {
+            GPIB_DPRINTK("%s: %s: bulk transfers returned %i %i, bytes_read=%i\n", __FILE__, __FUNCTION__,
+                         message->out_context.result, message->in_context.result, message->in_context.actual_length);
+            [self dump_raw_block:message->in_data : message->in_context.actual_length];
+            retval = -EIO;
+            continue;
+        }
+        if(message->in_data[0] != (0xff & ~message->command))
+        {
+            GPIB_DPRINTK("%s: %s: error, bulk command=0x%x != ~0x%x\n", __FILE__, __FUNCTION__, message->in_data[0], message->command);
+            retval = -EIO;
+            continue;
+        }
+        if(message->in_data[1])
+        {
+            GPIB_DPRINTK("%s: %s: nonzero error code 0x%x in response to 0x%x\n", __FILE__, __FUNCTION__, message->in_data[1], message->command);
+            retval = -EIO;
+            continue;
+        }
+        if(message->command == DATA_PIPE_CMD_RD_REGS)
+        {
+            if(message->in_context.actual_length < 2 + message->count)
+            {
+                GPIB_DPRINTK("%s: %s: short DATA_PIPE_CMD_RD_REGS response, bytes_read=%i\n", __FILE__, __FUNCTION__, message->in_context.actual_length);
+                retval = -EIO;
+                continue;
+            }
+            for(j = 0; j < message->count; j++)
+                message->reads[j]->value = message->in_data[2 + j];
+        }
     }
+    return retval;
+}
+
+-(SInt32) write_registers:(const struct register_pairlet *) writes : (UInt32) num_writes
+{
+    register_batch batch;
+    UInt32 j;
+    
+    [self batch_init:&batch];
+    for(j = 0; j < num_writes; j++)
+        [self batch_write:&batch : writes[j].address : writes[j].value];
+    return [self batch_flush:&batch : YES];
+}
+
+-(SInt32) read_registers:(struct register_pairlet *) reads : (UInt32) num_reads : (BOOL) blocking
+{
+    register_batch batch;
+    UInt32 j;
+    
+    [self batch_init:&batch];
     for(j = 0; j < num_reads; j++)
-    {
-        reads[j].value = in_data[i++];
-    }
-    free(in_data);
-    return 0;
+        [self batch_read:&batch : &reads[j]];
+    return [self batch_flush:&batch : blocking];
 }
 
 -(SInt32) abort:(BOOL) flush
@@ -411,6 +459,8 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     
     if(flush)
         wIndex |= XA_FLUSH;
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
     retval = [self receive_control_msg:control_request : USB_DIR_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE : XFER_ABORT : wIndex : status_data : sizeof(status_data) : 100];
     if(retval < 0)
     {
@@ -438,8 +488,23 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     }
 }
 
-// interface functions
--(SInt32) read:(UInt8 *) buffer : (UInt32) length : (BOOL *) end : (UInt32 *) nbytes_read
+/* the transfer in progress waits on the bulk pipes rather than on the
+ * watchdog, cancelling them completes it with kIOReturnAborted */
+-(void) abort_io
+{
+    IOUSBInterfaceInterface300 **bus_interface = m_private.bus_interface;
+    
+    [super abort_io];
+    if(bus_interface == NULL)
+        return;
+    (*bus_interface)->AbortPipe(bus_interface, m_private.bulk_in_endpoint);
+    (*bus_interface)->AbortPipe(bus_interface, m_private.bulk_out_endpoint);
+}
+
+/* a negative 'pad' lets the caller do the addressing (ARF_NO_ADDRESS),
+ * otherwise the firmware addresses the device at 'pad'/'sad' as talker.
+ * With 'spoll' the firmware conducts a serial poll of that device instead */
+-(SInt32) generic_read:(UInt8 *) buffer : (UInt32) length : (SInt32) pad : (SInt32) sad : (BOOL) spoll : (BOOL *) end : (UInt32 *) nbytes_read
 {
     SInt32 retval;
     //UInt8 *out_data;//, *in_data;
@@ -454,10 +519,20 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     //out_data_length = 0x9;
     //out_data = calloc(out_data_length, sizeof(UInt8));
     out_data[i++] = DATA_PIPE_CMD_READ;
-    out_data[i++] = 0;	//primary address when ARF_NO_ADDR is not set
-    out_data[i++] = 0;	//secondary address when ARF_NO_ADDR is not set
-    out_data[i] = ARF_NO_ADDRESS | ARF_END_ON_EOI;
-    if(m_eos_mode & REOS)
+    if(pad < 0)
+    {
+        out_data[i++] = 0;
+        out_data[i++] = 0;
+        out_data[i] = ARF_NO_ADDRESS | ARF_END_ON_EOI;
+    }else
+    {
+        out_data[i++] = pad;
+        out_data[i++] = (sad >= 0) ? MSA(sad) : 0;
+        out_data[i] = ARF_END_ON_EOI;
+        if(spoll)
+            out_data[i] |= ARF_SPOLL;
+    }
+    if((m_eos_mode & REOS) && spoll == NO)
         out_data[i] |= ARF_END_ON_EOS_CHAR;
     ++i;
     out_data[i++] = length & 0xff;
@@ -482,95 +557,420 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         return -EIO;
     }
     in_data_length = length + 1;
-    //in_data = calloc(in_data_length, sizeof(UInt8));
-    //retval = [self receive_bulk_msg:in_data : in_data_length :&bytes_read : msec_timeout];
-    retval = [self receive_bulk_msg:buffer : in_data_length :&bytes_read : msec_timeout];
+    retval = [self receive_read_data:buffer : in_data_length : &bytes_read : &trailing_flags : msec_timeout];
+    pthread_mutex_unlock(&m_bulk_transfer_lock);
+    //GPIB_DPRINTK("%s: %s: received response:\n", __FILE__, __FUNCTION__);
+    //dump_raw_block(in_data, in_data_length);
+    if(bytes_read >= 1)
+    {
+        *nbytes_read = bytes_read - 1;
+        if(trailing_flags & (ATRF_EOI | ATRF_EOS)) *end = YES;
+    }
+    //FIXME check trailing flags for error
+    return retval;
+}
+
+/*
+ * \brief  Pipelined read through the bulk in pipe
+ *
+ * Receives up to 'length' bytes into 'buffer' keeping up to
+ * AGILENT_82357_READS_IN_FLIGHT transfers of agilent_82357_read_chunk_length
+ * queued on the pipe, so the adapter never waits for the host to ask for
+ * the next chunk.  The pipe completes the transfers in order, a short one
+ * ends the answer and the transfers queued after it are cancelled.
+ */
+-(SInt32) receive_bulk_pipelined:(UInt8 *) buffer : (UInt32) length : (UInt32 *) actual_data_length : (UInt32) timeout_msecs
+{
+    SInt32 retval = 0;
+    bulk_context contexts[AGILENT_82357_READS_IN_FLIGHT];
+    UInt32 lengths[AGILENT_82357_READS_IN_FLIGHT];
+    UInt32 submitted = 0, completed = 0, offset = 0, i;
+    BOOL ended = NO, cancelled = NO;
+    CFTimeInterval wait_seconds = timeout_msecs ? timeout_msecs / 1000.0 : 1.0e10;
+    
+    *actual_data_length = 0;
+    pthread_mutex_lock(&m_bulk_alloc_lock);
+    if(m_private.bus_interface == NULL)
+    {
+        pthread_mutex_unlock(&m_bulk_alloc_lock);
+        return -ENODEV;
+    }
+    for(i = 0; i < AGILENT_82357_READS_IN_FLIGHT; i++)
+    {
+        contexts[i].runner = CFRunLoopGetCurrent();
+        contexts[i].complete = CFRunLoopSourceCreate(NULL, 0, &m_source_context);
+    }
+    for(;;)
+    {
+        bulk_context *context;
+        SInt32 result;
+        
+        /* keep the pipe full */
+        while(retval == 0 && ended == NO && offset < length && submitted - completed < AGILENT_82357_READS_IN_FLIGHT)
+        {
+            i = submitted % AGILENT_82357_READS_IN_FLIGHT;
+            context = &contexts[i];
+            context->timed_out = NO;
+            context->triggered = NO;
+            context->actual_length = 0;
+            context->result = 0;
+            lengths[i] = (length - offset < agilent_82357_read_chunk_length) ? length - offset : agilent_82357_read_chunk_length;
+            retval = (*m_private.bus_interface)->ReadPipeAsyncTO(m_private.bus_interface, m_private.bulk_in_endpoint, buffer + offset, lengths[i], timeout_msecs, 0, &bulk_complete, context);
+            if(retval)
+            {
+                GPIB_DPRINTK("%s: failed to submit bulk in urb, retval=%i\n", __FILE__, retval);
+                break;
+            }
+            offset += lengths[i];
+            ++submitted;
+        }
+        if(completed == submitted)
+            break;
+        
+        /* wait for the oldest transfer */
+        i = completed % AGILENT_82357_READS_IN_FLIGHT;
+        context = &contexts[i];
+        while(!context->triggered)
+        {
+            if(CFRunLoopRunInMode(kCFRunLoopDefaultMode, wait_seconds, YES) == kCFRunLoopRunTimedOut && cancelled == NO)
+            {
+                context->timed_out = YES;
+                (*m_private.bus_interface)->AbortPipe(m_private.bus_interface, m_private.bulk_in_endpoint);
+                cancelled = YES;
+            }
+        }
+        ++completed;
+        /* transfers cancelled after the end of the answer carry no data */
+        if(ended)
+            continue;
+        *actual_data_length += context->actual_length;
+        if(context->timed_out || context->result == kIOReturnTimeout)
+            result = -ETIMEDOUT;
+        else
+            result = context->result;
+        if(result || context->actual_length < lengths[i])
+        {
+            ended = YES;
+            if(retval == 0)
+                retval = result;
+            if(cancelled == NO && completed < submitted)
+            {
+                (*m_private.bus_interface)->AbortPipe(m_private.bus_interface, m_private.bulk_in_endpoint);
+                cancelled = YES;
+            }
+        }
+    }
+    pthread_mutex_unlock(&m_bulk_alloc_lock);
+    for(i = 0; i < AGILENT_82357_READS_IN_FLIGHT; i++)
+    {
+        CFRunLoopSourceInvalidate(contexts[i].complete);
+        CFRelease(contexts[i].complete);
+    }
+    return retval;
+}
+
+/* receives up to 'length' bytes of a read answer into 'buffer', aborting
+ * the transfer on error or timeout */
+-(SInt32) receive_read_part:(UInt8 *) buffer : (UInt32) length : (UInt32 *) bytes_read : (UInt32) msec_timeout
+{
+    SInt32 retval;
+    
+    if(length > agilent_82357_read_chunk_length)
+        retval = [self receive_bulk_pipelined:buffer : length : bytes_read : msec_timeout];
+    else
+        retval = [self receive_bulk_msg:buffer : length : bytes_read : msec_timeout];
     if(retval == -ETIMEDOUT)
     {
         UInt32 extra_bytes_read;
         SInt32 extra_bytes_retval;
         [self abort:YES];
-        //extra_bytes_retval = [self receive_bulk_msg:in_data + bytes_read : in_data_length - bytes_read : &extra_bytes_read : 100];
-        extra_bytes_retval = [self receive_bulk_msg:buffer + bytes_read : in_data_length - bytes_read : &extra_bytes_read : 100];
+        extra_bytes_retval = [self receive_bulk_msg:buffer + *bytes_read : length - *bytes_read : &extra_bytes_read : 100];
         GPIB_DPRINTK("%s: %s: receive_bulk_msg timed out, bytes_read=%i, extra_bytes_read=%i\n",
-              __FILE__, __FUNCTION__, bytes_read, extra_bytes_read);
-        bytes_read += extra_bytes_read;
+              __FILE__, __FUNCTION__, *bytes_read, extra_bytes_read);
+        *bytes_read += extra_bytes_read;
         if(extra_bytes_retval)
         {
             GPIB_DPRINTK("%s: %s: extra_bytes_retval=%i, bytes_read=%i\n", __FILE__, __FUNCTION__,
-                  extra_bytes_retval, bytes_read);
+                  extra_bytes_retval, *bytes_read);
             [self abort:NO];
         }
     }else if(retval)
     {
         GPIB_DPRINTK("%s: %s: receive_bulk_msg returned %i, bytes_read=%i\n", __FILE__, __FUNCTION__,
-              retval, bytes_read);
+              retval, *bytes_read);
         [self abort:NO];
     }
-    pthread_mutex_unlock(&m_bulk_transfer_lock);
-    if(bytes_read > length + 1)
+    if(*bytes_read > length)
     {
-        bytes_read = length + 1;
+        *bytes_read = length;
         GPIB_DPRINTK("%s: %s: bytes_read > length? truncating", __FILE__, __FUNCTION__);
     }
-    //GPIB_DPRINTK("%s: %s: received response:\n", __FILE__, __FUNCTION__);
-    //dump_raw_block(in_data, in_data_length);
-    if(bytes_read >= 1)
+    return retval;
+}
+
+/* Receives the answer of a DATA_PIPE_CMD_READ: at most 'length' - 1 data
+ * bytes followed by the trailing flags byte.  The whole packets go straight
+ * to 'buffer', the last partial packet and the flags through a small bounce
+ * buffer, so 'buffer' needs no room for the flags.  'bytes_read' counts the
+ * flags byte, which is stored in 'trailing_flags'.
+ */
+-(SInt32) receive_read_data:(UInt8 *) buffer : (UInt32) length : (UInt32 *) bytes_read : (UInt8 *) trailing_flags : (UInt32) msec_timeout
+{
+    SInt32 retval = 0;
+    UInt8 tail[AGILENT_82357_MAX_PACKET + 1];
+    UInt32 direct_length = 0, tail_read = 0;
+    
+    *bytes_read = 0;
+    if(m_private.bulkInPacketSize && m_private.bulkInPacketSize <= AGILENT_82357_MAX_PACKET)
+        direct_length = (length - 1) - (length - 1) % m_private.bulkInPacketSize;
+    if(direct_length)
+    {
+        retval = [self receive_read_part:buffer : direct_length : bytes_read : msec_timeout];
+        /* a short packet ended the transfer, the flags are in 'buffer' */
+        if(retval || *bytes_read < direct_length)
+        {
+            if(*bytes_read >= 1)
+                *trailing_flags = buffer[*bytes_read - 1];
+            return retval;
+        }
+    }
+    retval = [self receive_read_part:tail : length - direct_length : &tail_read : msec_timeout];
+    if(tail_read >= 1)
     {
-        //memcpy(buffer, in_data, bytes_read - 1);
-        //trailing_flags = in_data[bytes_read - 1];
-        trailing_flags = buffer[bytes_read - 1];
-        *nbytes_read = bytes_read - 1;
-        if(trailing_flags & (ATRF_EOI | ATRF_EOS)) *end = YES;
+        memcpy(buffer + direct_length, tail, tail_read - 1);
+        *trailing_flags = tail[tail_read - 1];
+        *bytes_read = direct_length + tail_read;
+    }else if(direct_length)
+    {
+        /* the data ended on a packet boundary */
+        *trailing_flags = buffer[direct_length - 1];
     }
-    //free(in_data);
-    //FIXME check trailing flags for error
     return retval;
 }
 
--(SInt32) generic_write:(UInt8 *) buffer : (UInt32) length : (BOOL) send_commands : (BOOL) send_eoi : (UInt32 *) bytes_written
+/* records the ATN state a bus operation left, unknown when it failed */
+-(SInt32) atn_after:(SInt32) retval : (SInt8) state
+{
+    m_atn_state = retval ? ATN_STATE_UNKNOWN : state;
+    if(retval)
+        m_adsr_valid = NO;
+    return retval;
+}
+
+/* follows the addressing of the board itself through the command bytes
+ * it sends, to keep the cached ADSR talker/listener bits right */
+-(void) track_commands:(const UInt8 *) buffer : (UInt32) length
+{
+    UInt8 pad = [super getPad];
+    UInt8 command;
+    UInt32 i;
+    
+    for(i = 0; i < length; i++)
+    {
+        command = buffer[i] & 0x7f;
+        if(command == UNL)
+            m_adsr &= ~HR_LA;
+        else if(command == UNT)
+            m_adsr &= ~HR_TA;
+        else if(command == MLA(pad))
+            m_adsr |= HR_LA;
+        else if(command == MTA(pad))
+            m_adsr |= HR_TA;
+        else if(command >= MTA(0) && command < UNT)
+            m_adsr &= ~HR_TA;
+    }
+}
+
+// interface functions
+-(SInt32) read:(UInt8 *) buffer : (UInt32) length : (BOOL *) end : (UInt32 *) nbytes_read
+{
+    return [self atn_after:[self generic_read:buffer : length : -1 : -1 : NO : end : nbytes_read] : m_atn_state];
+}
+
+-(BOOL) supports_addressed_io
+{
+    return YES;
+}
+
+/* AIF_SRQ on the interrupt endpoint sets SRQI, see interrupt_complete() */
+-(BOOL) interrupt_srq
+{
+    return YES;
+}
+
+-(SInt32) addressed_read:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL *) end : (UInt32 *) nbytes_read
+{
+    /* the firmware makes us listener and releases ATN once the device
+     * is addressed */
+    m_adsr = (m_adsr & ~HR_TA) | HR_LA;
+    return [self atn_after:[self generic_read:buffer : length : pad : sad : NO : end : nbytes_read] : ATN_STATE_RELEASED];
+}
+
+-(BOOL) supports_serial_poll
+{
+    return YES;
+}
+
+-(UInt32) direct_read_length
+{
+    if(m_private.bulkInPacketSize == 0 || m_private.bulkInPacketSize > AGILENT_82357_MAX_PACKET)
+        return 0;
+    return agilent_82357_max_read_length;
+}
+
+-(UInt32) direct_write_length
+{
+    return agilent_82357_max_write_length;
+}
+
+-(SInt32) addressed_serial_poll:(UInt16) pad : (SInt16) sad : (UInt8 *) status_byte
+{
+    SInt32 retval;
+    BOOL end;
+    UInt32 nbytes_read;
+    /* room for the status byte and the trailing flags */
+    UInt8 in_data[2];
+    
+    retval = [self generic_read:in_data : 1 : pad : sad : YES : &end : &nbytes_read];
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
+    if(retval < 0)
+        return retval;
+    if(nbytes_read < 1)
+        return -EIO;
+    *status_byte = in_data[0];
+    return 0;
+}
+
+/* sends 'length' bytes of 'data' as one bulk message */
+-(SInt32) send_bulk_all:(void *) data : (UInt32) length : (UInt32) msec_timeout
+{
+    SInt32 retval;
+    UInt32 raw_bytes_written = 0;
+    
+    retval = [self send_bulk_msg:data : length : &raw_bytes_written : msec_timeout];
+    if(retval == 0 && raw_bytes_written != length)
+    {
+        GPIB_DPRINTK("%s: raw_bytes_written=%i, length=%i\n", __FILE__, raw_bytes_written, length);
+        return -EIO;
+    }
+    return retval;
+}
+
+/* sends the data of a write announced with AWF_SEPARATE_HEADER straight
+ * from the segments.  Every bulk message but the last is a whole number of
+ * packets, so a segment tail is sent along with the head of the next one */
+-(SInt32) send_bulk_segments:(const struct iovec *) iov : (UInt32) iov_count : (UInt32) msec_timeout
+{
+    UInt8 carry[AGILENT_82357_MAX_PACKET];
+    UInt32 carry_length = 0, length, part, i;
+    UInt8 *data;
+    SInt32 retval;
+    
+    for(i = 0; i < iov_count; i++)
+    {
+        data = iov[i].iov_base;
+        length = (UInt32) iov[i].iov_len;
+        if(carry_length)
+        {
+            part = (length < sizeof(carry) - carry_length) ? length : (UInt32) sizeof(carry) - carry_length;
+            memcpy(carry + carry_length, data, part);
+            carry_length += part;
+            data += part;
+            length -= part;
+            if(carry_length < sizeof(carry))
+                continue;
+            retval = [self send_bulk_all:carry : carry_length : msec_timeout];
+            if(retval) return retval;
+            carry_length = 0;
+        }
+        /* the last segment can end on a short packet */
+        part = (i == iov_count - 1) ? length : length - length % sizeof(carry);
+        if(part)
+        {
+            retval = [self send_bulk_all:data : part : msec_timeout];
+            if(retval) return retval;
+        }
+        memcpy(carry, data + part, length - part);
+        carry_length = length - part;
+    }
+    if(carry_length)
+        return [self send_bulk_all:carry : carry_length : msec_timeout];
+    return 0;
+}
+
+-(SInt32) generic_write:(UInt8 *) buffer : (UInt32) length : (SInt32) pad : (SInt32) sad : (BOOL) send_commands : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    struct iovec segment;
+    
+    segment.iov_base = buffer;
+    segment.iov_len = length;
+    return [self generic_writev:&segment : 1 : pad : sad : send_commands : send_eoi : bytes_written];
+}
+
+/* a negative 'pad' lets the caller do the addressing (AWF_NO_ADDRESS),
+ * otherwise the firmware addresses the device at 'pad'/'sad' as listener.
+ * A short write is gathered in a single bulk message, a longer one is sent
+ * as the header (AWF_SEPARATE_HEADER) followed by the segments themselves
+ * so the data is never copied, all of it being a single firmware write */
+-(SInt32) generic_writev:(const struct iovec *) iov : (UInt32) iov_count : (SInt32) pad : (SInt32) sad : (BOOL) send_commands : (BOOL) send_eoi : (UInt32 *) bytes_written
 {
     SInt32 retval;
     UInt8 status_data[0x8] = {0,0,0,0,0,0,0,0};
-    UInt8 * out_data;
-    SInt32 out_data_length;
-    UInt32 raw_bytes_written;
+    UInt8 out_data[AGILENT_82357_MAX_PACKET];
+    UInt32 length = 0;
     UInt32 i = 0, j;
     UInt32 msec_timeout;
+    BOOL separate_header;
     
     *bytes_written = 0;
-    out_data_length = length + 0x8;
-    out_data = calloc(out_data_length, sizeof(UInt8));
+    for(j = 0; j < iov_count; j++)
+        length += (UInt32) iov[j].iov_len;
+    separate_header = (length + 0x8 > sizeof(out_data));
     out_data[i++] = DATA_PIPE_CMD_WRITE;
-    out_data[i++] = 0; // primary address when AWF_NO_ADDRESS is not set
-    out_data[i++] = 0; // secondary address when AWF_NO_ADDRESS is not set
-    out_data[i] = AWF_NO_ADDRESS | AWF_NO_FAST_TALKER_FIRST_BYTE;
+    if(pad < 0 || send_commands)
+    {
+        out_data[i++] = 0;
+        out_data[i++] = 0;
+        out_data[i] = AWF_NO_ADDRESS | AWF_NO_FAST_TALKER_FIRST_BYTE;
+    }else
+    {
+        out_data[i++] = pad;
+        out_data[i++] = (sad >= 0) ? MSA(sad) : 0;
+        out_data[i] = AWF_NO_FAST_TALKER_FIRST_BYTE;
+    }
     if(send_commands)
         out_data[i] |= AWF_ATN | AWF_NO_FAST_TALKER;
     if(send_eoi)
         out_data[i] |= AWF_SEND_EOI;
+    if(separate_header)
+        out_data[i] |= AWF_SEPARATE_HEADER;
     ++i;
     out_data[i++] = length & 0xff;
     out_data[i++] = (length >> 8) & 0xff;
     out_data[i++] = (length >> 16) & 0xff;
     out_data[i++] = (length >> 24) & 0xff;
-    for(j = 0; j < length; j++)
-        out_data[i++] = buffer[j] & 0xff;
+    if(separate_header == NO)
+    {
+        for(j = 0; j < iov_count; j++)
+        {
+            memcpy(out_data + i, iov[j].iov_base, iov[j].iov_len);
+            i += iov[j].iov_len;
+        }
+    }
     //GPIB_DPRINTK("%s: sending bulk msg(), send_commands=%i\n", __FUNCTION__, send_commands);
     [gpib_board clear_bit:AIF_WRITE_COMPLETE_BN : &m_private.interrupt_flags];
     msec_timeout = [super getUsecTimeout] / 1000;
     retval = pthread_mutex_lock(&m_bulk_transfer_lock);
     if(retval)
-    {
-        free(out_data);
         return retval;
-    }
-    retval = [self send_bulk_msg:out_data : i : &raw_bytes_written : msec_timeout];
-    free(out_data);
-    if(retval || raw_bytes_written != i)
+    retval = [self send_bulk_all:out_data : i : msec_timeout];
+    if(retval == 0 && separate_header)
+        retval = [self send_bulk_segments:iov : iov_count : msec_timeout];
+    if(retval)
     {
         [self abort:NO];
-        GPIB_DPRINTK("%s: send_bulk_msg returned %i, raw_bytes_written=%i, i=%i\n", __FILE__, retval, raw_bytes_written, i);
+        GPIB_DPRINTK("%s: send_bulk_msg returned %i\n", __FILE__, retval);
         pthread_mutex_unlock(&m_bulk_transfer_lock);
         if(retval < 0) return retval;
         return -EIO;
@@ -578,7 +978,7 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     CFRunLoopRunResult res = 0;
     while(res!=kCFRunLoopRunTimedOut) {
         res = CFRunLoopRunInMode(kCFRunLoopDefaultMode, (msec_timeout/1000.0), YES);
-        if([gpib_board test_bit:AIF_WRITE_COMPLETE_BN : &m_private.interrupt_flags] || [gpib_board test_bit:TIMO_NUM : &m_private_board.status])
+        if([gpib_board test_bit:AIF_WRITE_COMPLETE_BN : &m_private.interrupt_flags] || [self io_timed_out])
         {
             //GPIB_DPRINTK("Interrupt completed in generic Write");
             break;
@@ -591,11 +991,16 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         pthread_mutex_unlock(&m_bulk_transfer_lock);
         return -EIO;
     }
-    if([gpib_board test_bit:AIF_WRITE_COMPLETE_BN : &m_private.interrupt_flags] == NO)
+    if([gpib_board test_bit:AIF_WRITE_COMPLETE_BN : &m_private.interrupt_flags])
     {
-        GPIB_DPRINTK("Abort generic Write %u", m_private.interrupt_flags);
-        [self abort:NO];
+        /* the firmware only reports completion once every byte went out,
+         * the transfer status is needed to count a partial write */
+        pthread_mutex_unlock(&m_bulk_transfer_lock);
+        *bytes_written = length;
+        return 0;
     }
+    GPIB_DPRINTK("Abort generic Write %u", m_private.interrupt_flags);
+    [self abort:NO];
     //GPIB_DPRINTK("%s: receiving control msg\n", __FUNCTION__);
     retval = [self receive_control_msg:control_request : USB_DIR_IN | USB_TYPE_VENDOR | USB_RECIP_DEVICE : XFER_STATUS : 0 : status_data : sizeof(status_data) : 100];
     pthread_mutex_unlock(&m_bulk_transfer_lock);
@@ -614,12 +1019,33 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
 
 -(SInt32) write:(UInt8 *) buffer : (UInt32) length : (BOOL) send_eoi : (UInt32 *) bytes_written
 {
-    return [self generic_write:buffer : length : NO : send_eoi : bytes_written];
+    return [self atn_after:[self generic_write:buffer : length : -1 : -1 : NO : send_eoi : bytes_written] : m_atn_state];
+}
+
+-(SInt32) addressed_write:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    /* the firmware makes us talker and releases ATN once the device
+     * is addressed */
+    m_adsr = (m_adsr & ~HR_LA) | HR_TA;
+    return [self atn_after:[self generic_write:buffer : length : pad : sad : NO : send_eoi : bytes_written] : ATN_STATE_RELEASED];
+}
+
+-(SInt32) writev:(const struct iovec *) iov : (UInt32) iov_count : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    return [self atn_after:[self generic_writev:iov : iov_count : -1 : -1 : NO : send_eoi : bytes_written] : m_atn_state];
+}
+
+-(SInt32) addressed_writev:(const struct iovec *) iov : (UInt32) iov_count : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    m_adsr = (m_adsr & ~HR_LA) | HR_TA;
+    return [self atn_after:[self generic_writev:iov : iov_count : pad : sad : NO : send_eoi : bytes_written] : ATN_STATE_RELEASED];
 }
 
 -(SInt32) command:(UInt8 *)buffer : (UInt32) length : (UInt32 *) bytes_written
 {
-    return [self generic_write:buffer : length : YES : NO : bytes_written];
+    [self track_commands:buffer : length];
+    /* the command bytes go out with AWF_ATN */
+    return [self atn_after:[self generic_write:buffer : length : -1 : -1 : YES : NO : bytes_written] : ATN_STATE_ASSERTED];
 }
 
 -(SInt32) take_control:(BOOL) synchronous
@@ -627,6 +1053,8 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     struct register_pairlet write;
     SInt32 retval;
     
+    if(m_is_cic && m_atn_state == ATN_STATE_ASSERTED)
+        return 0;
     write.address = AUXCR;
     if(synchronous==YES)
     {
@@ -639,7 +1067,7 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         GPIB_DPRINTK("%s: %s: write_registers() returned error\n", __FILE__, __FUNCTION__);
     }
     
-    return retval;
+    return [self atn_after:retval : ATN_STATE_ASSERTED];
 }
 
 -(SInt32) go_to_standby
@@ -647,6 +1075,8 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     struct register_pairlet write;
     SInt32 retval;
     
+    if(m_atn_state == ATN_STATE_RELEASED)
+        return 0;
     write.address = AUXCR;
     write.value = AUX_GTS;
     retval = [self write_registers:&write : 1];
@@ -654,7 +1084,7 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     {
         GPIB_DPRINTK("%s: %s: write_registers() returned error\n", __FILE__, __FUNCTION__);
     }
-    return retval;
+    return [self atn_after:retval : ATN_STATE_RELEASED];
 }
 
 -(SInt32) request_system_control:(BOOL) request_control
@@ -676,10 +1106,21 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         m_hw_control_bits &= ~SYSTEM_CONTROLLER;
     }
     ++i;
-    writes[i].address = HW_CONTROL;
-    writes[i].value = m_hw_control_bits;
-    ++i;
+    /* HW_CONTROL is only rewritten when the system controller bit changes */
+    if(m_hw_control_valid == NO || m_hw_control_written != m_hw_control_bits)
+    {
+        writes[i].address = HW_CONTROL;
+        writes[i].value = m_hw_control_bits;
+        ++i;
+    }
     retval = [self write_registers:writes : i];
+    if(i > 1)
+    {
+        m_hw_control_valid = (retval == 0);
+        m_hw_control_written = m_hw_control_bits;
+    }
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
     if(retval)
     {
         GPIB_DPRINTK("%s: %s: write_registers() returned error\n", __FILE__, __FUNCTION__);
@@ -699,6 +1140,8 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         write.value |= AUX_CS;
         m_is_cic = YES;
     }
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
     retval = [self write_registers:&write : 1];
     if(retval)
     {
@@ -718,6 +1161,7 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     {
         write.value |= AUX_CS;
     }
+    m_adsr_valid = NO;
     retval = [self write_registers:&write : 1];
     if(retval)
     {
@@ -755,13 +1199,26 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         status |= CIC;
     else
         status &= ~CIC;
-    address_status.address = ADSR;
-    retval = [self read_registers:&address_status : 1 : NO];
-    if(retval)
-    {
-        GPIB_DPRINTK("%s: %s: read_registers() returned error\n", __FILE__, __FUNCTION__);
-        return status;
+    /* SRQI comes from the interrupt endpoint and the ADSR bits are tracked
+     * through our own bus operations, only read ADSR when they are lost.
+     * Another controller addresses us without us knowing, so ADSR is
+     * always read when we are not CIC */
+    if(m_is_cic == NO || m_adsr_valid == NO || m_atn_state == ATN_STATE_UNKNOWN || [super getStatusRefresh])
+    {
+        address_status.address = ADSR;
+        retval = [self read_registers:&address_status : 1 : NO];
+        if(retval)
+        {
+            GPIB_DPRINTK("%s: %s: read_registers() returned error\n", __FILE__, __FUNCTION__);
+            return status;
+        }
+        m_adsr = address_status.value;
+        m_adsr_valid = YES;
+        m_atn_state = (address_status.value & HR_ATN) ? ATN_STATE_ASSERTED : ATN_STATE_RELEASED;
     }
+    address_status.value = m_adsr & ~HR_ATN;
+    if(m_atn_state == ATN_STATE_ASSERTED)
+        address_status.value |= HR_ATN;
     // check for remote/local
     if(address_status.value & HR_REM)
         [gpib_board set_bit:REM_NUM : &status];
@@ -814,41 +1271,40 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
 
 -(SInt32) parallel_poll:(UInt8 *) result
 {
-    struct register_pairlet writes[2];
+    register_batch batch;
     struct register_pairlet read;
     SInt32 retval;
     
     // execute parallel poll
-    writes[0].address = AUXCR;
-    writes[0].value = AUX_CS | AUX_RPP;
-    writes[1].address = HW_CONTROL;
-    writes[1].value = m_hw_control_bits & ~NOT_PARALLEL_POLL;
-    retval = [self write_registers:writes : 2];
+    [self batch_init:&batch];
+    [self batch_write:&batch : AUXCR : AUX_CS | AUX_RPP];
+    [self batch_write:&batch : HW_CONTROL : m_hw_control_bits & ~NOT_PARALLEL_POLL];
+    retval = [self batch_flush:&batch : YES];
+    m_hw_control_valid = (retval == 0);
+    m_hw_control_written = m_hw_control_bits & ~NOT_PARALLEL_POLL;
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
     if(retval)
     {
-        GPIB_DPRINTK("%s: %s: write_registers() returned error\n", __FILE__, __FUNCTION__);
+        GPIB_DPRINTK("%s: %s: batch_flush() returned error\n", __FILE__, __FUNCTION__);
         return retval;
     }
     usleep(2);	//silly, since usb write will take way longer
+    // read the answer and clear parallel poll state in one message
+    [self batch_init:&batch];
     read.address = CPTR;
-    retval = [self read_registers:&read : 1 : YES];
+    [self batch_read:&batch : &read];
+    [self batch_write:&batch : HW_CONTROL : m_hw_control_bits | NOT_PARALLEL_POLL];
+    [self batch_write:&batch : AUXCR : AUX_RPP];
+    retval = [self batch_flush:&batch : YES];
+    m_hw_control_valid = (retval == 0);
+    m_hw_control_written = m_hw_control_bits | NOT_PARALLEL_POLL;
     if(retval)
     {
-        GPIB_DPRINTK("%s: %s: read_registers() returned error\n", __FILE__, __FUNCTION__);
+        GPIB_DPRINTK("%s: %s: batch_flush() returned error\n", __FILE__, __FUNCTION__);
         return retval;
     }
     *result = read.value;
-    // clear parallel poll state
-    writes[0].address = HW_CONTROL;
-    writes[0].value = m_hw_control_bits | NOT_PARALLEL_POLL;
-    writes[1].address = AUXCR;
-    writes[1].value = AUX_RPP;
-    retval = [self write_registers:writes : 2];
-    if(retval)
-    {
-        GPIB_DPRINTK("%s: %s: write_registers() returned error\n", __FILE__, __FUNCTION__);
-        return retval;
-    }
     return 0;
 }
 -(void) parallel_poll_configure:(UInt8) config
@@ -978,6 +1434,7 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
 
 -(SInt32) init_interface
 {
+    register_batch batch;
     struct register_pairlet hw_control;
     struct register_pairlet writes[0x20];
     SInt32 retval;
@@ -1061,20 +1518,21 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
         GPIB_DPRINTK("%s: %s: bug! writes[] overflow\n", __FILE__, __FUNCTION__);
         return -EFAULT;
     }
-    retval = [self write_registers:writes : i];
-    if(retval)
-    {
-        GPIB_DPRINTK("%s: %s: write_registers() returned error\n", __FILE__, __FUNCTION__);
-        return -EIO;
-    }
+    [self batch_init:&batch];
+    for(UInt32 j = 0; j < i; j++)
+        [self batch_write:&batch : writes[j].address : writes[j].value];
     hw_control.address = HW_CONTROL;
-    retval = [self read_registers:&hw_control : 1 : YES];
+    [self batch_read:&batch : &hw_control];
+    retval = [self batch_flush:&batch : YES];
     if(retval)
     {
-        GPIB_DPRINTK("%s: %s: read_registers() returned error\n", __FILE__, __FUNCTION__);
+        GPIB_DPRINTK("%s: %s: batch_flush() returned error\n", __FILE__, __FUNCTION__);
         return -EIO;
     }
     m_hw_control_bits = (hw_control.value & ~0x7) | NOT_TI_RESET | NOT_PARALLEL_POLL;
+    m_hw_control_valid = NO;
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
     return 0;
 }
 
@@ -1303,6 +1761,9 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
     writes[i].value = AUX_CS | AUX_CHIP_RESET;
     ++i;
     m_hw_control_bits &= ~NOT_TI_RESET;
+    m_hw_control_valid = NO;
+    m_atn_state = ATN_STATE_UNKNOWN;
+    m_adsr_valid = NO;
     writes[i].address = HW_CONTROL;
     writes[i].value = m_hw_control_bits;
     ++i;
@@ -1472,6 +1933,7 @@ pthread_mutex_t hotplug_lock = PTHREAD_MUTEX_INITIALIZER;
                 else if (direction == kUSBIn && transferType == kUSBBulk)
                 {
                     m_private.bulk_in_endpoint = pipeRef;
+                    m_private.bulkInPacketSize = maxPacketSize;
                     GPIB_DPRINTK("In Endpoint is %d", m_private.bulk_in_endpoint);
                     if(maxPacketSize < m_private.maxInOutPacketSize)
                         m_private.maxInOutPacketSize = maxPacketSize-8;
@@ -16,7 +16,8 @@ int ibconfig (int ud, int option, int v) {
     unsigned int res =  [gvisa ibconfig:ud:option:v];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 }
 
@@ -25,7 +26,8 @@ void FindLstn(int boardID, const Addr4882_t addrlist[], Addr4882_t * results, in
     [gvisa FindLstn:boardID:addrlist:results:limit];
     ibsta = [gvisa ThreadIbsta];
     iberr = [gvisa ThreadIberr];
-    ibcnt = ibcntl = [gvisa ThreadIbcnt];
+    ibcntl = [gvisa ThreadIbcntl];
+    ibcnt = (int)ibcntl;
 };
 
 void Receive(int boardID, Addr4882_t addr, void * buffer, long cnt, int Termination){
@@ -33,28 +35,41 @@ void Receive(int boardID, Addr4882_t addr, void * buffer, long cnt, int Terminat
     [gvisa Receive:boardID:addr:buffer:cnt:Termination];
     ibsta = [gvisa ThreadIbsta];
     iberr = [gvisa ThreadIberr];
-    ibcnt = ibcntl = [gvisa ThreadIbcnt];
+    ibcntl = [gvisa ThreadIbcntl];
+    ibcnt = (int)ibcntl;
 };
 void Send(int boardID, Addr4882_t addr, const void * databuf, long datacnt, int eotMode) {
     ibinit();
     [gvisa Send:boardID:addr:databuf:datacnt:eotMode];
     ibsta = [gvisa ThreadIbsta];
     iberr = [gvisa ThreadIberr];
-    ibcnt = ibcntl = [gvisa ThreadIbcnt];
+    ibcntl = [gvisa ThreadIbcntl];
+    ibcnt = (int)ibcntl;
 };
 void SendIFC        (int boardID) {
     ibinit();
     [gvisa SendIFC:boardID];
     ibsta = [gvisa ThreadIbsta];
     iberr = [gvisa ThreadIberr];
-    ibcnt = ibcntl = [gvisa ThreadIbcnt];
+    ibcntl = [gvisa ThreadIbcntl];
+    ibcnt = (int)ibcntl;
+};
+int ibaionotify(int ud, gpib_aio_callback_t callback, void *data) {
+    ibinit();
+	unsigned int res = [gvisa ibaionotify:ud:callback:data];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
 };
 int ibask    (int ud, int option, int * v) {
     ibinit();
     unsigned int res = [gvisa ibask:ud:option:v];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibclr    (int ud){
@@ -62,7 +77,8 @@ int ibclr    (int ud){
 	unsigned int res = [gvisa ibclr:ud];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibpct    (int ud){
@@ -70,7 +86,8 @@ int ibpct    (int ud){
 	unsigned int res = [gvisa ibpct:ud];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int   ibdev   (int boardID, int pad, int sad, int tmo, int eot, int eos){
@@ -78,7 +95,8 @@ int   ibdev   (int boardID, int pad, int sad, int tmo, int eot, int eos){
 	int res =  [gvisa ibdev:boardID:pad:sad:tmo:eot:eos];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibonl (int ud, int v){
@@ -86,7 +104,8 @@ int ibonl (int ud, int v){
 	unsigned int res =  [gvisa ibonl:ud:v];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 
@@ -95,7 +114,8 @@ int ibcac (int ud, int sync) {
     unsigned int res =  [gvisa ibcac:ud:sync];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 }
 int ibgts (int ud, int shadow) {
@@ -103,7 +123,8 @@ int ibgts (int ud, int shadow) {
     unsigned int res =  [gvisa ibgts:ud:shadow];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 }
 int ibsre (int ud, int v) {
@@ -111,7 +132,8 @@ int ibsre (int ud, int v) {
 	unsigned int res =  [gvisa ibsre:ud:v];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 
@@ -120,7 +142,8 @@ int ibtmo (int ud, int v) {
 	unsigned int res =  [gvisa ibtmo:ud:v];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt = ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 
@@ -129,7 +152,44 @@ int ibrd     (int ud, void * buf, long cnt){
 	unsigned int res =  [gvisa ibrd:ud:buf:cnt];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-    ibcnt = ibcntl = [gvisa ThreadIbcnt];
+    ibcntl = [gvisa ThreadIbcntl];
+    ibcnt = (int)ibcntl;
+	return res;
+};
+int ibrda    (int ud, void * buf, long cnt){
+    ibinit();
+	unsigned int res =  [gvisa ibrda:ud:buf:cnt];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
+int ibrdblock(int ud, void * buf, long cnt, long * block_length){
+    ibinit();
+	unsigned int res =  [gvisa ibrdblock:ud:buf:cnt:block_length];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
+int ibrdblockalloc(int ud, void ** block, long * block_length){
+    ibinit();
+	unsigned int res =  [gvisa ibrdblockalloc:ud:block:block_length];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
+int ibrdtmo  (int ud, void * buf, long cnt, unsigned int usec_timeout){
+    ibinit();
+	unsigned int res =  [gvisa ibrdtmo:ud:buf:cnt:usec_timeout];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibrsp    (int ud, char * spr){
@@ -153,24 +213,45 @@ int ibwrt    (int ud, const void * buf, long cnt){
 	unsigned int res =  [gvisa ibwrt:ud:buf:cnt];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
+int ibwrttmo (int ud, const void * buf, long cnt, unsigned int usec_timeout){
+    ibinit();
+	unsigned int res =  [gvisa ibwrttmo:ud:(void *)buf:cnt:usec_timeout];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
+int ibwrtv   (int ud, const struct iovec * iov, int cnt){
+    ibinit();
+	unsigned int res =  [gvisa ibwrtv:ud:iov:cnt];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int  ibcmd    (int ud, const void * buf, long cnt) {
     ibinit();
-	unsigned int res =  [gvisa ibcmda:ud:buf:cnt];
+	unsigned int res =  [gvisa ibcmd:ud:buf:cnt];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 
 int  ibcmda   (int ud, const void * buf, long cnt) {
     ibinit();
-	unsigned int res =  [gvisa ibcmd:ud:buf:cnt];
+	unsigned int res =  [gvisa ibcmda:ud:buf:cnt];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibln     (int ud, int pad, int sad, short * listen) {
@@ -178,7 +259,8 @@ int ibln     (int ud, int pad, int sad, short * listen) {
 	unsigned int res =  [gvisa ibln:ud:pad:sad:listen];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int iblines     (int ud, short * status) {
@@ -186,7 +268,8 @@ int iblines     (int ud, short * status) {
 	unsigned int res =  [gvisa iblines:ud:status];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int  ibloc    (int ud) {
@@ -194,7 +277,8 @@ int  ibloc    (int ud) {
 	unsigned int res =  [gvisa ibloc:ud];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibtrg    (int ud) {
@@ -202,23 +286,45 @@ int ibtrg    (int ud) {
 	unsigned int res =  [gvisa ibtrg:ud];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 
+int ibstop   (int ud) {
+    ibinit();
+	unsigned int res =  [gvisa ibstop:ud];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
 int ibwait   (int ud, int mask) {
     ibinit();
 	unsigned int res =  [gvisa ibwait:ud:mask];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
+	return res;
+};
+int ibwaitany(const int ud_list[], const int mask_list[], int count, int *index) {
+    ibinit();
+	unsigned int res =  [gvisa ibwaitany:ud_list:mask_list:count:index];
+	ibsta = [gvisa ThreadIbsta];
+	iberr = [gvisa ThreadIberr];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibwrta   (int ud, const void * buf, long cnt) {
+    ibinit();
 	unsigned int res =  [gvisa ibwrta:ud:buf:cnt];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 void ibvers( char **version) {
@@ -230,7 +336,8 @@ int  ibfind  (const char * udname) {
 	unsigned int res =  [gvisa ibfind:udname];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 int ibspb( int ud, short *sp_bytes ) {
@@ -238,7 +345,8 @@ int ibspb( int ud, short *sp_bytes ) {
 	unsigned int res =  [gvisa ibspb:ud:sp_bytes];
 	ibsta = [gvisa ThreadIbsta];
 	iberr = [gvisa ThreadIberr];
-	ibcnt =  ibcntl = [gvisa ThreadIbcnt];
+	ibcntl = [gvisa ThreadIbcntl];
+	ibcnt = (int)ibcntl;
 	return res;
 };
 
@@ -246,5 +354,5 @@ int ibspb( int ud, short *sp_bytes ) {
 
 int ThreadIbsta() { return [gvisa ThreadIbsta]; }
 int ThreadIbcnt() { return [gvisa ThreadIbcnt]; }
-long ThreadIbcntl() { return [gvisa ThreadIbcnt]; }
+long ThreadIbcntl() { return [gvisa ThreadIbcntl]; }
 int ThreadIberr() { return [gvisa ThreadIberr]; }
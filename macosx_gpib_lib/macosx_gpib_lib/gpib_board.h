@@ -21,6 +21,7 @@
 //#import <Foundation/Foundation.h>
 #import <stdatomic.h>
 #import <pthread.h>
+#import <sys/uio.h>
 #import "gpib_user.h"
 
 
@@ -30,15 +31,22 @@
 
 @class gpib_board;
 
-/* argument for read/write/command ioctls */
-/*
+/* argument for read/write/command ioctls, the counts are 64 bits wide so a
+ * single call can stream more than 4GB, the link splits it in board sized
+ * transfers */
 typedef struct
 {
     UInt8 *buffer_ptr;
-    UInt16 requested_transfer_count;
-    UInt16 completed_transfer_count;
-    BOOL end;
+    UInt64 requested_transfer_count;
+    UInt64 completed_transfer_count;
+    BOOL end;	/* read: EOI or EOS ended the transfer, write: send EOI with the last byte */
+    BOOL address;	/* read/write: let the board address the device with the first buffer load,
+                     command: the bytes address the device of 'handle' */
+    BOOL device_talks;	/* command with 'address': the device is addressed to talk, else to listen */
     SInt32 handle;
+    UInt32 usec_timeout;	/* board timeout for this transfer, 0 waits forever */
+    const struct iovec *iov;	/* write: if iov_count isn't 0 the data is gathered from these segments */
+    UInt32 iov_count;
 } read_write_ioctl_t;
 
 typedef struct
@@ -51,7 +59,7 @@ typedef struct
     UInt32 pad;
     SInt32 sad;
     UInt32 usec_timeout;
-} wait_ioctl_t;*/
+} wait_ioctl_t;
 
 typedef struct
 {
@@ -63,8 +71,23 @@ typedef struct
     UInt32 t1_delay;
     BOOL ist : YES;
     BOOL no_7_bit_eos : YES;
+    BOOL addressed_io : YES;
+    BOOL status_refresh : YES;
 } board_info_ioctl_t;
 
+/* argument for the serial poll list ioctl, 'results' gets the status byte
+ * of each device polled */
+typedef struct
+{
+    const UInt16 *pads;
+    const SInt16 *sads;
+    UInt8 *results;
+    UInt32 requested_transfer_count;
+    UInt32 completed_transfer_count;
+    UInt32 usec_timeout;
+    BOOL stop_on_rqs;
+} serial_poll_list_ioctl_t;
+
 typedef struct
 {
     CFRunLoopSourceRef wait;
@@ -72,8 +95,32 @@ typedef struct
     /* Used to hold the board's current status (see update_status() above)
      */
     UInt32 status;
+    /* number of events signaled on the board, see gpib_event_count() */
+    UInt64 event_count;
 }private_board;
 
+/* status bits whose changes wake the board (interrupt endpoint, wait
+ * timer, end of an I/O, autopoll), waits only have to look at them again
+ * after gpib_wake_board() */
+static const int wait_event_bits = TIMO | END | CMPL | SRQI | RQS;
+/* how often waits look at the other bits (ATN, CIC, LACS...) */
+static const CFTimeInterval wait_poll_interval = 0.01;
+/* sleep of a wait when only event bits are waited for */
+static const CFTimeInterval wait_forever = 1.0e10;
+
+/* signals the board's wait source and wakes up the threads blocked in
+ * gpib_wait_event(), to be called on every change of the board status */
+void gpib_wake_board(private_board *board);
+/* only wakes up the threads blocked in gpib_wait_event() on 'board', for
+ * status changes made outside of it (completion of asynchronous I/O) */
+void gpib_signal_event(private_board *board);
+/* number of events signaled on 'board' so far */
+UInt64 gpib_event_count(private_board *board);
+/* blocks until the event count of one of the 'num_boards' boards differs
+ * from its entry in 'counts' or until 'timeout' seconds have elapsed.
+ * Returns YES if a board signaled an event. */
+BOOL gpib_wait_event(private_board * const *boards, const UInt64 *counts, int num_boards, CFTimeInterval timeout);
+
 struct wait_info
 {
     CFRunLoopTimerRef timer;
@@ -89,7 +136,7 @@ struct wait_info
     UInt16 pad;	/* primary gpib address */
     SInt16 sad;	/* secondary gpib address (negative means disabled) */
     //atomic_t io_in_progress;
-    atomic_flag io_in_progress;
+    atomic_bool io_in_progress;
     BOOL is_board : YES;
 }
 @end;
@@ -125,6 +172,8 @@ struct wait_info
     /* list of open devices connected to this board */
     NSMutableArray *m_device_list;
     CFRunLoopSourceContext m_source_context;
+    /* set by abort_io() from another thread to end the transfer in progress */
+    atomic_bool m_io_abort;
 @public
     private_board m_private_board;
     pthread_mutex_t m_big_gpib_mutex;
@@ -152,6 +201,9 @@ struct wait_info
 @property(readwrite) UInt32 t1NanoNsec;
 /* autospoll kernel thread */
 @property(getter=getAutoSpoll) SInt16 autoSpoll;
+/* make update_status() read the status from the hardware instead of
+ * trusting the state the board keeps track of */
+@property(getter=getStatusRefresh) BOOL statusRefresh;
 
 
 -(void) getBoardInfo:(board_info_ioctl_t *) info;
@@ -183,6 +235,46 @@ struct wait_info
  * written or negative value on error.
  */
 -(SInt32) write:(UInt8 *) buffer : (UInt32) length : (BOOL) send_eoi : (UInt32 *) bytes_written;
+/* supports_addressed_io() returns YES if the board can address a device
+ * itself as part of a data transfer, in which case the UNL/MLA/MTA commands
+ * don't need to be sent with command() before reading or writing.
+ */
+-(BOOL) supports_addressed_io;
+/* addressed_read() and addressed_write() behave like read() and write()
+ * but first make the device at 'pad'/'sad' (negative sad disables) talker,
+ * respectively listener, and the board listener, respectively talker.
+ * Only called if supports_addressed_io() returns YES.
+ */
+-(SInt32) addressed_read:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL *) end : (UInt32 *) nbytes_read;
+-(SInt32) addressed_write:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written;
+/* writev() and addressed_writev() behave like write() and addressed_write()
+ * for data gathered from 'iov_count' non empty segments, with EOI only
+ * sent along with the last byte of the last one.  Only called if
+ * direct_write_length() isn't zero, the segments then add up to at most
+ * that length.  The default implementation writes each segment in turn.
+ */
+-(SInt32) writev:(const struct iovec *) iov : (UInt32) iov_count : (BOOL) send_eoi : (UInt32 *) bytes_written;
+-(SInt32) addressed_writev:(const struct iovec *) iov : (UInt32) iov_count : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written;
+/* supports_serial_poll() returns YES if the board can conduct a complete
+ * serial poll (SPE, talk address, status byte, SPD) as a single operation.
+ */
+-(BOOL) supports_serial_poll;
+/* addressed_serial_poll() serial polls the device at 'pad'/'sad' (negative
+ * sad disables) and stores its status byte in 'status_byte'.  Zero return
+ * value for success, negative return indicates error.
+ * Only called if supports_serial_poll() returns YES.
+ */
+-(SInt32) addressed_serial_poll:(UInt16) pad : (SInt16) sad : (UInt8 *) status_byte;
+/* direct_read_length() returns the largest 'length' read() accepts when
+ * 'buffer' is the caller's buffer, which then needs no room beyond
+ * 'length' bytes.  Zero means reads must go through the board buffer.
+ */
+-(UInt32) direct_read_length;
+/* direct_write_length() returns the largest 'length' write() accepts
+ * straight from the caller's buffer.  Zero means writes must go through
+ * the board buffer.
+ */
+-(UInt32) direct_write_length;
 /* command() writes the command bytes in 'buffer' to the bus
  * Returns zero on success or negative value on error.
  */
@@ -230,6 +322,11 @@ struct wait_info
  * worry about setting the CMPL, END, TIMO, or ERR bits.
  */
 -(UInt32) update_status:(UInt32) clear_mask;
+/* interrupt_srq() returns YES if the board sets SRQI in its status as soon
+ * as SRQ is asserted, the bus lines then only need to be read to find out
+ * that it was released.
+ */
+-(BOOL) interrupt_srq;
 /* Sets primary address 0-30 for gpib interface card.
  */
 -(SInt32) primary_address:(UInt16) address;
@@ -261,6 +358,10 @@ struct wait_info
 -(void) removeWaitTimer:(struct wait_info *) winfo;
 -(void) init_wait_info: (struct wait_info *) winfo;
 -(BOOL) io_timed_out;
+/* may be called from any thread, ends the transfer in progress as if it
+ * had timed out, the request is forgotten when the next transfer starts */
+-(void) abort_io;
+-(BOOL) io_aborted;
 -(SInt32) gpib_allocate_board:(UInt32) length;
 -(void) gpib_deallocate_board;
 -(UInt32) num_status_bytes:(gpib_status_queue *) dev;
@@ -19,13 +19,81 @@
  */
 
 #import "gpib_board.h"
+#import <sys/time.h>
+
+/* guards the event counts of the boards, for the waits that don't run on
+ * a link thread */
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_condition = PTHREAD_COND_INITIALIZER;
+
+void gpib_signal_event(private_board *board)
+{
+    pthread_mutex_lock(&event_lock);
+    board->event_count++;
+    pthread_cond_broadcast(&event_condition);
+    pthread_mutex_unlock(&event_lock);
+}
+
+void gpib_wake_board(private_board *board)
+{
+    gpib_signal_event(board);
+    if(board->wait != 0)
+        CFRunLoopSourceSignal(board->wait);
+    if(board->runner != 0)
+        CFRunLoopWakeUp(board->runner);
+}
+
+UInt64 gpib_event_count(private_board *board)
+{
+    UInt64 count;
+    
+    pthread_mutex_lock(&event_lock);
+    count = board->event_count;
+    pthread_mutex_unlock(&event_lock);
+    return count;
+}
+
+/* called with event_lock held */
+static BOOL gpib_event_signaled(private_board * const *boards, const UInt64 *counts, int num_boards)
+{
+    int i;
+    
+    for(i = 0; i < num_boards; i++)
+    {
+        if(boards[i]->event_count != counts[i])
+            return YES;
+    }
+    return NO;
+}
+
+BOOL gpib_wait_event(private_board * const *boards, const UInt64 *counts, int num_boards, CFTimeInterval timeout)
+{
+    struct timeval now;
+    struct timespec deadline;
+    double seconds;
+    BOOL signaled;
+    
+    gettimeofday(&now, NULL);
+    seconds = now.tv_sec + now.tv_usec / 1.0e6 + timeout;
+    deadline.tv_sec = (time_t)seconds;
+    deadline.tv_nsec = (long)((seconds - deadline.tv_sec) * 1.0e9);
+    pthread_mutex_lock(&event_lock);
+    /* every board shares the condition, a wake up for another board
+     * only costs looking at the counts again */
+    while((signaled = gpib_event_signaled(boards, counts, num_boards)) == NO)
+    {
+        if(pthread_cond_timedwait(&event_condition, &event_lock, &deadline) == ETIMEDOUT)
+            break;
+    }
+    pthread_mutex_unlock(&event_lock);
+    return signaled;
+}
 
 void watchdog_timeout(CFRunLoopTimerRef timer, void *info)
 {
     private_board *board = (private_board*) info;
     [gpib_board set_bit:TIMO_NUM : &board->status];
-    CFRunLoopSourceSignal(board->wait);
-    CFRunLoopWakeUp(board->runner);
+    gpib_wake_board(board);
 }
 
 static void wait_timeout(CFRunLoopTimerRef timer, void *info)
@@ -33,8 +101,7 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
 {
     struct wait_info *winfo = (struct wait_info*) info;
     winfo->timed_out = YES;
-    CFRunLoopSourceSignal(winfo->board->wait);
-    CFRunLoopWakeUp(winfo->board->runner);
+    gpib_wake_board(winfo->board);
 }
 
 @implementation gpib_status_queue
@@ -74,6 +141,71 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
                                    reason:[NSString stringWithFormat:@"You must override %@ in a subclass", NSStringFromSelector(_cmd)]
                                  userInfo:nil];
 }
+-(BOOL) supports_addressed_io
+{
+    return NO;
+}
+-(SInt32) addressed_read:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL *) end : (UInt32 *) nbytes_read
+{
+    @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                   reason:[NSString stringWithFormat:@"You must override %@ in a subclass", NSStringFromSelector(_cmd)]
+                                 userInfo:nil];
+}
+-(SInt32) addressed_write:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                   reason:[NSString stringWithFormat:@"You must override %@ in a subclass", NSStringFromSelector(_cmd)]
+                                 userInfo:nil];
+}
+-(SInt32) writev:(const struct iovec *) iov : (UInt32) iov_count : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    SInt32 retval = 0;
+    UInt32 i, nbytes;
+    
+    *bytes_written = 0;
+    for(i = 0; i < iov_count; i++)
+    {
+        nbytes = 0;
+        retval = [self write:iov[i].iov_base : (UInt32) iov[i].iov_len : send_eoi && i == iov_count - 1 : &nbytes];
+        *bytes_written += nbytes;
+        if(retval < 0 || nbytes < iov[i].iov_len)
+            break;
+    }
+    return retval;
+}
+-(SInt32) addressed_writev:(const struct iovec *) iov : (UInt32) iov_count : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    SInt32 retval;
+    UInt32 nbytes = 0;
+    
+    *bytes_written = 0;
+    if(iov_count == 0)
+        return 0;
+    retval = [self addressed_write:iov[0].iov_base : (UInt32) iov[0].iov_len : pad : sad : send_eoi && iov_count == 1 : bytes_written];
+    if(retval < 0 || *bytes_written < iov[0].iov_len || iov_count == 1)
+        return retval;
+    retval = [self writev:iov + 1 : iov_count - 1 : send_eoi : &nbytes];
+    *bytes_written += nbytes;
+    return retval;
+}
+-(BOOL) supports_serial_poll
+{
+    return NO;
+}
+-(UInt32) direct_read_length
+{
+    return 0;
+}
+-(UInt32) direct_write_length
+{
+    return 0;
+}
+-(SInt32) addressed_serial_poll:(UInt16) pad : (SInt16) sad : (UInt8 *) status_byte
+{
+    @throw [NSException exceptionWithName:NSInternalInconsistencyException
+                                   reason:[NSString stringWithFormat:@"You must override %@ in a subclass", NSStringFromSelector(_cmd)]
+                                 userInfo:nil];
+}
 -(SInt32) command:(UInt8 *)buffer : (UInt32) length : (UInt32 *) bytes_written
 {
     @throw [NSException exceptionWithName:NSInternalInconsistencyException
@@ -149,6 +281,10 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
                                    reason:[NSString stringWithFormat:@"You must override %@ in a subclass", NSStringFromSelector(_cmd)]
                                  userInfo:nil];
 }
+-(BOOL) interrupt_srq
+{
+    return NO;
+}
 -(SInt32) primary_address:(UInt16) address
 {
     @throw [NSException exceptionWithName:NSInternalInconsistencyException
@@ -283,6 +419,7 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
             return;
         }
     [gpib_board clear_bit:TIMO_NUM : &m_private_board.status];
+    atomic_store(&m_io_abort, NO);
     
     if( usec_timeout > 0 )
     {
@@ -310,12 +447,23 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
 
 -(BOOL) io_timed_out
 {
-    if([gpib_board test_bit:TIMO_NUM : &m_private_board.status])
+    if([gpib_board test_bit:TIMO_NUM : &m_private_board.status] || atomic_load(&m_io_abort))
         return YES;
     else
         return NO;
 }
 
+-(void) abort_io
+{
+    atomic_store(&m_io_abort, YES);
+    gpib_wake_board(&m_private_board);
+}
+
+-(BOOL) io_aborted
+{
+    return atomic_load(&m_io_abort);
+}
+
 // osinit.c
 -(id) init_gpib_board
 {
@@ -324,6 +472,7 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
     _buffer = nil;
     _bufferLength = 0;
     m_private_board.status = 0;
+    atomic_init(&m_io_abort, NO);
     pthread_mutex_init(&m_big_gpib_mutex, NULL);
     m_timer = nil;
     m_device_list = [[NSMutableArray alloc] init];
@@ -499,6 +648,8 @@ static void wait_timeout(CFRunLoopTimerRef timer, void *info)
     info->t1_delay = _t1NanoNsec;
     info->ist = _ist;
     info->no_7_bit_eos = m_no_7_bit_eos;
+    info->addressed_io = [self supports_addressed_io];
+    info->status_refresh = _statusRefresh;
 }
 
 +(BOOL) test_bit:(UInt32) pos : (UInt32 *) var
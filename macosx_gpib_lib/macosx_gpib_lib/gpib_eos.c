@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+#include <string.h>
+#include "gpib_eos.h"
+
+#if defined( __SSE2__ )
+#include <emmintrin.h>
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+#include <arm_neon.h>
+#endif
+
+static ssize_t find_eos_7_bit_scalar( const uint8_t *buffer, size_t index, size_t length, uint8_t eos )
+{
+	for( ; index < length; index++ )
+	{
+		if( ( buffer[ index ] & 0x7f ) == eos )
+			return index;
+	}
+	return -1;
+}
+
+/* 'eos' has its high bit clear.  The wide loop only tells in which 64
+ * byte block the first match is, the narrower ones find it */
+static ssize_t find_eos_7_bit( const uint8_t *buffer, size_t length, uint8_t eos )
+{
+	size_t index = 0;
+#if defined( __SSE2__ )
+	const __m128i mask = _mm_set1_epi8( 0x7f );
+	const __m128i target = _mm_set1_epi8( ( char ) eos );
+	__m128i match[ 4 ];
+	int bits, i;
+
+	for( ; index + 64 <= length; index += 64 )
+	{
+		for( i = 0; i < 4; i++ )
+			match[ i ] = _mm_cmpeq_epi8( _mm_and_si128( _mm_loadu_si128( ( const __m128i * )( buffer + index + 16 * i ) ), mask ), target );
+		if( _mm_movemask_epi8( _mm_or_si128( _mm_or_si128( match[ 0 ], match[ 1 ] ), _mm_or_si128( match[ 2 ], match[ 3 ] ) ) ) )
+			break;
+	}
+	for( ; index + 16 <= length; index += 16 )
+	{
+		bits = _mm_movemask_epi8( _mm_cmpeq_epi8( _mm_and_si128( _mm_loadu_si128( ( const __m128i * )( buffer + index ) ), mask ), target ) );
+		if( bits )
+			return index + __builtin_ctz( bits );
+	}
+#elif defined( __ARM_NEON ) && defined( __aarch64__ )
+	const uint8x16_t mask = vdupq_n_u8( 0x7f );
+	const uint8x16_t target = vdupq_n_u8( eos );
+	uint8x16_t match[ 4 ];
+	int i;
+
+	for( ; index + 64 <= length; index += 64 )
+	{
+		for( i = 0; i < 4; i++ )
+			match[ i ] = vceqq_u8( vandq_u8( vld1q_u8( buffer + index + 16 * i ), mask ), target );
+		if( vmaxvq_u8( vorrq_u8( vorrq_u8( match[ 0 ], match[ 1 ] ), vorrq_u8( match[ 2 ], match[ 3 ] ) ) ) )
+			break;
+	}
+	for( ; index + 16 <= length; index += 16 )
+	{
+		if( vmaxvq_u8( vceqq_u8( vandq_u8( vld1q_u8( buffer + index ), mask ), target ) ) )
+			break;
+	}
+#endif
+	return find_eos_7_bit_scalar( buffer, index, length, eos );
+}
+
+ssize_t gpib_find_eos( const uint8_t *buffer, size_t length, uint8_t eos, int compare_8_bits )
+{
+	const uint8_t *match;
+
+	if( compare_8_bits == 0 )
+		return find_eos_7_bit( buffer, length, eos & 0x7f );
+
+	/* libc's memchr is already vectorized */
+	match = memchr( buffer, eos, length );
+	if( match == NULL )
+		return -1;
+	return match - buffer;
+}
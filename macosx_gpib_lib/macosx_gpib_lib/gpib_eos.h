@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+#ifndef _GPIB_EOS_H
+#define _GPIB_EOS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Index of the first byte of 'buffer' matching 'eos', -1 if there is none.
+ * With 'compare_8_bits' zero only the low 7 bits are compared (BIN flag
+ * clear), so 'eos' matches with or without its high bit.  The search is
+ * vectorized with SSE2 or NEON when the target has them. */
+ssize_t gpib_find_eos( const uint8_t *buffer, size_t length, uint8_t eos, int compare_8_bits );
+
+#endif	/* _GPIB_EOS_H */
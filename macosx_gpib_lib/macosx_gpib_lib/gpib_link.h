@@ -19,6 +19,7 @@
  */
 
 #import "gpib_sys.h"
+#import <dispatch/dispatch.h>
 
 
 /* Standard functions. */
@@ -51,9 +52,43 @@ enum gpib_ioctl
     IB_T1_DELAY,
     IBLOC,
     IBAUTOSPOLL,
-    IBONL
+    IBONL,
+    IBRSP_LIST,
+    IBSTATUS_REFRESH,
+    /* requests for the link thread itself rather than the board */
+    IBBOARD_NAME,
+    IBLINK_CANCEL
 };
 
+/* number of requests the link thread can have queued, a power of two */
+#define GPIB_LINK_RING_LENGTH 64
+/* segments of a gathered write passed to the board at once */
+#define GPIB_LINK_WRITE_SEGMENTS 16
+
+/* request of the submission ring, lives on the stack of the caller.
+ * Either 'arg' is set or 'ioctl_arg' is the typed argument of 'cmd'. */
+typedef struct gpib_link_request
+{
+    unsigned int cmd;
+    void *ioctl_arg;
+    gpib_link_arg *arg;
+    int retval;
+}gpib_link_request;
+
+/* Slot of the submission ring.  'sequence' tells the slot state: equal
+ * to the position it is free for a producer, equal to position + 1 it
+ * holds a request for the link thread.  'claim' is set to the position
+ * along with the request, whichever of the link thread and a caller past
+ * its deadline moves it on first owns the request.
+ */
+typedef struct
+{
+    atomic_ulong sequence;
+    atomic_ulong claim;
+    struct gpib_link_request *request;
+    dispatch_semaphore_t complete;	/* signaled once 'request' is done */
+}gpib_link_ring_slot;
+
 @interface gpib_link : gpib_sys
 {
 @protected
@@ -61,15 +96,36 @@ enum gpib_ioctl
     NSThread *m_linkthread;
     NSPort *m_port;
     Class m_class_gpib_board;
+    /* requests are pushed by any thread and popped by the link thread,
+     * which is woken through m_ring_source */
+    gpib_link_ring_slot m_ring[ GPIB_LINK_RING_LENGTH ];
+    atomic_ulong m_ring_head;
+    unsigned long m_ring_tail;
+    dispatch_semaphore_t m_ring_space;
+    CFRunLoopRef m_link_runloop;
+    CFRunLoopSourceRef m_ring_source;
+    BOOL m_ring_draining;	/* drain_ring is running, only used on the link thread */
+    /* talker/listener addressing the library last set up on the bus, lets
+     * a transfer to the same device skip the UNL/MLA/MTA command phase.
+     * Packed in one word so callers can read it while only the link
+     * thread writes it, 0 when unknown. */
+    atomic_uint m_addressing;
 }
 
 -(int) ibopen;
 -(int) ibclose;
 -(int) close;
 -(NSString*) ibname;
+-(BOOL) abort_io:(unsigned int) handle;
 -(BOOL) isAutoSpoll;
 -(void) setAutoSpoll:(BOOL) enable;
 -(id) init_gpib_link:(Class) class_gpib_board;
 -(int) ioctl:(gpib_link_arg *)arg;
+-(int) typed_ioctl:(unsigned int) cmd : (void *) ioctl_arg;
++(void) set_submit_deadline:(CFAbsoluteTime) deadline;
+-(int) submit:(gpib_link_request *) request;
+-(void) drain_ring;
+-(void) run_request:(gpib_link_request *) request;
+-(BOOL) is_addressed:(UInt16) pad : (SInt16) sad : (BOOL) device_talks;
 
 @end
@@ -25,12 +25,98 @@
 {
 }*/
 
+/* every thread has at most one request in the ring, so it waits for its
+ * completion on its own semaphore */
+static pthread_key_t link_complete_key;
+static pthread_once_t link_complete_once = PTHREAD_ONCE_INIT;
+
+static void link_complete_release(void *semaphore)
+{
+    dispatch_release((dispatch_semaphore_t) semaphore);
+}
+
+static void link_complete_key_alloc(void)
+{
+    pthread_key_create(&link_complete_key, link_complete_release);
+}
+
+static dispatch_semaphore_t link_complete_semaphore(void)
+{
+    dispatch_semaphore_t semaphore;
+    
+    pthread_once(&link_complete_once, link_complete_key_alloc);
+    semaphore = pthread_getspecific(link_complete_key);
+    if(semaphore == NULL)
+    {
+        semaphore = dispatch_semaphore_create(0);
+        pthread_setspecific(link_complete_key, semaphore);
+    }
+    return semaphore;
+}
+
+/* requests the thread submits are given up if not started by then, 0
+ * for none, see set_submit_deadline */
+static __thread CFAbsoluteTime link_submit_deadline;
+
+static dispatch_time_t link_dispatch_deadline(void)
+{
+    if(link_submit_deadline == 0)
+        return DISPATCH_TIME_FOREVER;
+    return dispatch_time(DISPATCH_TIME_NOW, (int64_t)((link_submit_deadline - CFAbsoluteTimeGetCurrent()) * NSEC_PER_SEC));
+}
+
+static void link_ring_perform(void *info)
+{
+    [(gpib_link *) info drain_ring];
+}
+
+/* fills 'chunk' with at most 'max_count' non empty pieces of the segments
+ * in 'iov', starting 'offset' bytes in and adding up to at most 'length'
+ * bytes.  Returns the number of pieces, their total goes to 'chunk_length' */
+static UInt32 link_iovec_chunk(const struct iovec *iov, UInt32 iov_count, UInt64 offset,
+                               struct iovec *chunk, UInt32 max_count, UInt32 length, UInt32 *chunk_length)
+{
+    UInt32 i, count = 0;
+    size_t piece;
+    
+    *chunk_length = 0;
+    for(i = 0; i < iov_count && count < max_count && *chunk_length < length; i++)
+    {
+        if(offset >= iov[i].iov_len)
+        {
+            offset -= iov[i].iov_len;
+            continue;
+        }
+        piece = iov[i].iov_len - (size_t) offset;
+        if(piece > length - *chunk_length)
+            piece = length - *chunk_length;
+        chunk[count].iov_base = (UInt8 *) iov[i].iov_base + offset;
+        chunk[count].iov_len = piece;
+        *chunk_length += (UInt32) piece;
+        count++;
+        offset = 0;
+    }
+    return count;
+}
+
 @implementation gpib_link
 
 -(id) init_gpib_link:(Class) class_gpib_board
 {
+    int i;
+    
     self = [super init];
     m_port = [[NSPort alloc] init];
+    for(i = 0; i < GPIB_LINK_RING_LENGTH; i++)
+    {
+        atomic_init(&m_ring[i].sequence, i);
+        atomic_init(&m_ring[i].claim, i);
+    }
+    atomic_init(&m_ring_head, 0);
+    atomic_init(&m_addressing, 0);
+    m_ring_tail = 0;
+    m_ring_draining = NO;
+    m_ring_space = dispatch_semaphore_create(GPIB_LINK_RING_LENGTH);
     m_linkthread = [[NSThread alloc] initWithTarget:self selector:@selector(linkThread) object:nil];
     [m_linkthread start];
     while([m_linkthread isExecuting]==NO);
@@ -42,6 +128,7 @@
 -(void) cancelThread:(NSThread*) thread
 {
     [self iboffline];
+    CFRunLoopSourceInvalidate(m_ring_source);
     [thread cancel];
     //CFRunLoopRef current = CFRunLoopGetCurrent();
     //CFRunLoopStop(current);
@@ -51,6 +138,13 @@
 {
     @autoreleasepool {
         NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+        CFRunLoopSourceContext context = {0};
+        
+        context.info = self;
+        context.perform = link_ring_perform;
+        m_ring_source = CFRunLoopSourceCreate(NULL, 0, &context);
+        m_link_runloop = CFRunLoopGetCurrent();
+        CFRunLoopAddSource(m_link_runloop, m_ring_source, kCFRunLoopDefaultMode);
         
         while ([[NSThread currentThread] isCancelled]==NO)
         {
@@ -73,6 +167,54 @@
 
 -(int) ioctl:(gpib_link_arg *)arg
 {
+    gpib_link_request request = { arg->cmd, NULL, arg, 0 };
+    
+    if([self submit:&request] < 0)
+        return -1;
+    /* like a system ioctl the error is left in errno */
+    if(arg->retval < 0)
+        errno = -arg->retval;
+    return arg->retval;
+}
+
+/* Same as ioctl: for the ioctls taking a typed argument (IBRD, IBWRT and
+ * IBCMD a read_write_ioctl_t, IBWAIT a wait_ioctl_t, IBBOARD_INFO a
+ * board_info_ioctl_t, IBRSP_LIST a serial_poll_list_ioctl_t, IBTMO an UInt32,
+ * IBMUTEX and IBONL a BOOL, IBLINK_CANCEL none), without allocating
+ * anything.
+ */
+-(int) typed_ioctl:(unsigned int) cmd : (void *) ioctl_arg
+{
+    gpib_link_request request = { cmd, ioctl_arg, nil, 0 };
+    
+    if([self submit:&request] < 0)
+        return -1;
+    if(request.retval < 0)
+        errno = -request.retval;
+    return request.retval;
+}
+
+/* Until called again with 0, the requests the calling thread submits
+ * fail with ETIMEDOUT if the link thread has not started them by
+ * 'deadline'.  Lets a wait on several boards keep its timeout while the
+ * link threads are busy with someone else's transfers.
+ */
++(void) set_submit_deadline:(CFAbsoluteTime) deadline
+{
+    link_submit_deadline = deadline;
+}
+
+/* Queues 'request' for the link thread and waits until it is done.  The
+ * push is lock free, a slot is reserved by moving m_ring_head forward and
+ * published by its sequence.  Requests of several threads queue up in the
+ * ring and the link thread runs them one after the other.
+ */
+-(int) submit:(gpib_link_request *) request
+{
+    dispatch_semaphore_t complete;
+    gpib_link_ring_slot *slot;
+    unsigned long position, claim;
+    
     if(m_linkthread != nil)
     {
         if([m_linkthread isExecuting]==NO)
@@ -80,12 +222,200 @@
     }
     else
         return -1;
-    pthread_mutex_lock(&m_board->m_big_gpib_mutex);
-    //pthread_mutex_lock(&arg->lock);
-    [self performSelector:@selector(ibioctl:) onThread:m_linkthread withObject:arg waitUntilDone:YES];
-    //pthread_mutex_unlock(&arg->lock);
-    pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
-    return arg->retval;
+    GPIB_PROFILE_START(start);
+    complete = link_complete_semaphore();
+    if(dispatch_semaphore_wait(m_ring_space, link_dispatch_deadline()))
+    {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    position = atomic_load_explicit(&m_ring_head, memory_order_relaxed);
+    while(YES)
+    {
+        slot = &m_ring[position & (GPIB_LINK_RING_LENGTH - 1)];
+        if(atomic_load_explicit(&slot->sequence, memory_order_acquire) == position)
+        {
+            if(atomic_compare_exchange_weak_explicit(&m_ring_head, &position, position + 1,
+                                                     memory_order_relaxed, memory_order_relaxed))
+                break;
+        }
+        else
+            position = atomic_load_explicit(&m_ring_head, memory_order_relaxed);
+    }
+    slot->request = request;
+    slot->complete = complete;
+    atomic_store_explicit(&slot->claim, position, memory_order_relaxed);
+    atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+    
+    CFRunLoopSourceSignal(m_ring_source);
+    CFRunLoopWakeUp(m_link_runloop);
+    if(dispatch_semaphore_wait(complete, link_dispatch_deadline()))
+    {
+        /* not started yet, the link thread will skip it.  Otherwise it
+         * is running and the request must outlive it */
+        claim = position;
+        if(atomic_compare_exchange_strong(&slot->claim, &claim, position + 1))
+        {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        dispatch_semaphore_wait(complete, DISPATCH_TIME_FOREVER);
+    }
+    GPIB_PROFILE_STOP(GPIB_PROFILE_LINK, start);
+    return 0;
+}
+
+/* runs the queued requests, on the link thread.  Boards wait for the bus
+ * in nested run loops which fire the ring source again, the requests
+ * pushed meanwhile are left to the outer call so that one request never
+ * runs in the middle of another */
+-(void) drain_ring
+{
+    gpib_link_ring_slot *slot;
+    gpib_link_request *request;
+    dispatch_semaphore_t complete;
+    unsigned long claim;
+    BOOL taken;
+    
+    if(m_ring_draining)
+        return;
+    m_ring_draining = YES;
+    while(YES)
+    {
+        slot = &m_ring[m_ring_tail & (GPIB_LINK_RING_LENGTH - 1)];
+        if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != m_ring_tail + 1)
+            break;
+        request = slot->request;
+        complete = slot->complete;
+        claim = m_ring_tail;
+        taken = atomic_compare_exchange_strong(&slot->claim, &claim, m_ring_tail + 1);
+        atomic_store_explicit(&slot->sequence, m_ring_tail + GPIB_LINK_RING_LENGTH, memory_order_release);
+        m_ring_tail++;
+        dispatch_semaphore_signal(m_ring_space);
+        /* given up by its caller, which is gone */
+        if(taken == NO)
+            continue;
+#ifdef GPIB_PROFILE
+        [self profile_request:request];
+#else
+        [self run_request:request];
+#endif
+        dispatch_semaphore_signal(complete);
+    }
+    m_ring_draining = NO;
+}
+
+#ifdef GPIB_PROFILE
+/* time spent on the link thread, the difference with the time measured
+ * in submit: is the cost of the thread hop */
+-(void) profile_request:(gpib_link_request *) request
+{
+    GPIB_PROFILE_START(start);
+    [self run_request:request];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_IOCTL, start);
+}
+#endif
+
+-(void) run_request:(gpib_link_request *) request
+{
+    [self track_addressing:request->arg != nil ? request->arg->cmd : request->cmd];
+    if(request->arg != nil)
+    {
+        [self ibioctl:request->arg];
+        return;
+    }
+    switch(request->cmd)
+    {
+        case IBRD:
+            request->retval = [self read_ioctl:(read_write_ioctl_t *) request->ioctl_arg];
+            break;
+        case IBWRT:
+            request->retval = [self write_ioctl:(read_write_ioctl_t *) request->ioctl_arg];
+            break;
+        case IBCMD:
+            request->retval = [self command_ioctl:(read_write_ioctl_t *) request->ioctl_arg];
+            break;
+        case IBWAIT:
+            request->retval = [self wait_ioctl:(wait_ioctl_t *) request->ioctl_arg];
+            break;
+        case IBTMO:
+            request->retval = [self timeout_ioctl:*(UInt32 *) request->ioctl_arg];
+            break;
+        case IBMUTEX:
+            request->retval = [self mutex_ioctl:*(BOOL *) request->ioctl_arg];
+            break;
+        case IBONL:
+            request->retval = [self online_ioctl:*(BOOL *) request->ioctl_arg];
+            break;
+        case IBBOARD_INFO:
+            request->retval = [self board_info_ioctl:(board_info_ioctl_t *) request->ioctl_arg];
+            break;
+        case IBRSP_LIST:
+            request->retval = [self serial_poll_list_ioctl:(serial_poll_list_ioctl_t *) request->ioctl_arg];
+            break;
+        case IBLINK_CANCEL:
+            [self cancelThread:m_linkthread];
+            request->retval = 0;
+            break;
+        default:
+            request->retval = -ENOTTY;
+            break;
+    }
+}
+
+/* forgets the cached addressing before any request that can change who
+ * talks and listens on the bus.  Reads and writes only change it when the
+ * board addresses the device itself or when they fail, and waits when
+ * another controller is in charge, see read_ioctl, write_ioctl and
+ * wait_ioctl */
+-(void) track_addressing:(unsigned int) cmd
+{
+    switch(cmd)
+    {
+        case IBCMD:
+        case IBONL:
+        case IBPAD:
+        case IBSAD:
+        case IBSIC:
+        case IBCAC:
+        case IBGTS:
+        case IBLOC:
+        case IBRPP:
+        case IBRSC:
+        case IBRSP:
+        case IBRSP_LIST:
+            atomic_store(&m_addressing, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+/* packs an addressing for m_addressing, never 0 */
+static unsigned int link_addressing(UInt16 pad, SInt16 sad, BOOL device_talks)
+{
+    if( sad < 0 ) sad = -1;
+    return 0x80000000U | ( device_talks ? 0x40000000U : 0 ) |
+        ( ( pad & 0xffU ) << 16 ) | (UInt16) sad;
+}
+
+/* may be called from any thread */
+-(BOOL) is_addressed:(UInt16) pad : (SInt16) sad : (BOOL) device_talks
+{
+    return atomic_load(&m_addressing) == link_addressing(pad, sad, device_talks);
+}
+
+/* link thread only */
+-(void) set_addressed:(UInt16) pad : (SInt16) sad : (BOOL) device_talks
+{
+    atomic_store(&m_addressing, link_addressing(pad, sad, device_talks));
+}
+
+/* serial polls address every device in turn */
+-(int) autopoll_all_devices
+{
+    atomic_store(&m_addressing, 0);
+    return [super autopoll_all_devices];
 }
 
 -(void) ibioctl:(gpib_link_arg *)arg
@@ -157,8 +487,7 @@
             return;
             break;
         case IBWAIT:
-            //arg->retval = [self wait_ioctl:&arg->wait];
-            arg->retval = [self wait_ioctl:arg->read_ioctl];
+            arg->retval = [self wait_ioctl:&arg->wait];
             //pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
             return;
             break;
@@ -187,8 +516,7 @@
             // IO ioctls can take a long time, we need to unlock board->big_gpib_mutex
             // before we call them.
             //pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
-            //arg->retval =  [self command_ioctl:&arg->readWrite];
-            arg->retval =  [self command_ioctl:arg->read_ioctl];
+            arg->retval =  [self command_ioctl:&arg->readWrite];
             return;
             break;
         case IBEOS:
@@ -215,8 +543,7 @@
             // IO ioctls can take a long time, we need to unlock board->big_gpib_mutex
             // before we call them.
             //pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
-            //arg->retval =  [self read_ioctl:&arg->readWrite];
-            arg->retval =  [self read_ioctl:arg->read_ioctl];
+            arg->retval =  [self read_ioctl:&arg->readWrite];
             return;
             break;
         case IBRPP:
@@ -234,6 +561,16 @@
             //pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
             return;
             break;
+        case IBSTATUS_REFRESH:
+            [m_board setStatusRefresh:arg->bEnable];
+            arg->retval = 0;
+            return;
+            break;
+        case IBBOARD_NAME:
+            [self getBoardName:arg];
+            arg->retval = 0;
+            return;
+            break;
         case IBRSV:
             arg->retval = [self request_service_ioctl:arg->nStatusByte];
             //pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
@@ -257,8 +594,7 @@
             // IO ioctls can take a long time, we need to unlock board->big_gpib_mutex
             // before we call them.
             //pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
-            //arg->retval = [self write_ioctl:&arg->readWrite];
-            arg->retval = [self write_ioctl:arg->read_ioctl];
+            arg->retval = [self write_ioctl:&arg->readWrite];
             return;
             break;
         default:
@@ -271,14 +607,12 @@
 
 -(int) ibopen
 {
+    BOOL online = YES;
+    
     if(m_linkthread != nil)
     {
         if([m_linkthread isExecuting]==YES)
-        {
-            pthread_mutex_lock(&m_board->m_big_gpib_mutex);
-            [self performSelector:@selector(ibonline) onThread:m_linkthread withObject:nil waitUntilDone:YES];
-            pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
-        }
+            [self typed_ioctl:IBONL : &online];
     }
     else
         return -1;
@@ -288,14 +622,12 @@
 
 -(int) ibclose
 {
+    BOOL online = NO;
+    
     if(m_linkthread != nil)
     {
         if([m_linkthread isExecuting]==YES)
-        {
-            pthread_mutex_lock(&m_board->m_big_gpib_mutex);
-            [self performSelector:@selector(iboffline) onThread:m_linkthread withObject:nil waitUntilDone:YES];
-            pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
-        }
+            [self typed_ioctl:IBONL : &online];
     }
     else
         return -1;
@@ -308,9 +640,9 @@
     if(m_linkthread != nil)
         if([m_linkthread isExecuting])
         {
-            pthread_mutex_lock(&m_board->m_big_gpib_mutex);
-            [self performSelector:@selector(cancelThread:) onThread:m_linkthread withObject:m_linkthread waitUntilDone:YES];
-            pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
+            /* queued behind the requests already submitted, the link
+             * thread stops once it has run them */
+            [self typed_ioctl:IBLINK_CANCEL : NULL];
             while([m_linkthread isFinished]==NO);
         }
     [self cleanup_open_devices ];
@@ -330,56 +662,85 @@
     gpib_link_arg *arg = [[gpib_link_arg alloc]init];
     if([m_linkthread isExecuting])
     {
-        pthread_mutex_lock(&m_board->m_big_gpib_mutex);
-        [self performSelector:@selector(getBoardName:) onThread:m_linkthread withObject:arg waitUntilDone:YES];
-        pthread_mutex_unlock(&m_board->m_big_gpib_mutex);
+        arg->cmd = IBBOARD_NAME;
+        [self ioctl:arg];
     }
     return arg->name;
 }
 
-//-(int) read_ioctl:(read_write_ioctl_t*) read_cmd
--(int) read_ioctl:(NSMutableDictionary*) read_cmd
+/* runs outside the link thread: cuts short the transfer 'handle' has in
+ * progress, returns NO when there is none (yet) */
+-(BOOL) abort_io:(unsigned int) handle
+{
+    gpib_descriptor *desc = nil;
+    BOOL in_progress;
+    
+    /* the link thread may be opening or closing devices meanwhile */
+    if(pthread_mutex_lock(&m_descriptors_mutex))
+        return NO;
+    if( handle < [m_descriptors count] )
+        desc = (gpib_descriptor*)[m_descriptors objectAtIndex:handle];
+    in_progress = ( desc != nil && atomic_load(&desc->io_in_progress) );
+    pthread_mutex_unlock(&m_descriptors_mutex);
+    
+    if( in_progress == NO )
+        return NO;
+    [m_board abort_io];
+    return YES;
+}
+
+-(int) read_ioctl:(read_write_ioctl_t*) read_cmd
 {
-    UInt16 remain;
+    UInt64 remain, index;
     BOOL end_flag = NO;
     int read_ret = 0;
-    gpib_descriptor *desc;
-    UInt32 nbytes, index;
+    gpib_descriptor *desc, *address = nil;
+    UInt32 nbytes, direct_length;
+    BOOL addressing;
     
-    //if(read_cmd->completed_transfer_count > read_cmd->requested_transfer_count)
-    if( [[read_cmd valueForKey:@"completed_transfer_count"] intValue] >
-        [[read_cmd valueForKey:@"requested_transfer_count"] intValue] )
+    if(read_cmd->completed_transfer_count > read_cmd->requested_transfer_count)
         return -EINVAL;
     
-    //desc = [self handle_to_descriptor:read_cmd->handle];
-    desc = [self handle_to_descriptor:[[read_cmd valueForKey:@"handle"] intValue]];
+    desc = [self handle_to_descriptor:read_cmd->handle];
     if( desc == NULL )
         return -EINVAL;
     
-    //remain = read_cmd->requested_transfer_count - read_cmd->completed_transfer_count;
-    remain = [[read_cmd valueForKey:@"requested_transfer_count"] intValue] -
-                [[read_cmd valueForKey:@"completed_transfer_count"] intValue];
+    [m_board setUsecTimeout:read_cmd->usec_timeout];
+    
+    remain = read_cmd->requested_transfer_count - read_cmd->completed_transfer_count;
+    
+    /* let the board address the device with the first buffer load */
+    if( read_cmd->address && desc->is_board == NO && [m_board supports_addressed_io] )
+        address = desc;
+    addressing = ( address != nil );
+    if( addressing )
+        atomic_store(&m_addressing, 0);
     
-    atomic_flag_test_and_set(&desc->io_in_progress);
+    /* boards that can, read straight into the user supplied buffer */
+    direct_length = [m_board direct_read_length];
+    
+    atomic_store(&desc->io_in_progress, YES);
     /* Read buffer loads till we fill the user supplied buffer */
-    index = 0;
+    index = read_cmd->completed_transfer_count;
     while(remain > 0 && end_flag == 0)
     {
         nbytes = 0;
-        read_ret = [self ibrd:[m_board getBuffer] : (([m_board getBufferLength] < remain) ? [m_board getBufferLength] :
-                                                        remain) : &end_flag : &nbytes];
+        if(direct_length)
+            read_ret = [self ibrd:read_cmd->buffer_ptr + index : (UInt32)((direct_length < remain) ? direct_length :
+                                                        remain) : address : &end_flag : &nbytes];
+        else
+            read_ret = [self ibrd:[m_board getBuffer] : (UInt32)(([m_board getBufferLength] < remain) ? [m_board getBufferLength] :
+                                                        remain) : address : &end_flag : &nbytes];
+        address = nil;
         if(nbytes == 0) break;
-        //for(int i = 0; i < nbytes ; i++)
-            //read_cmd->buffer_ptr[i+index] = [m_board getBuffer][i];
-        [[read_cmd valueForKey:@"buffer"] appendBytes:[m_board getBuffer] length:nbytes];
+        if(direct_length == 0)
+            memcpy(read_cmd->buffer_ptr + index, [m_board getBuffer], nbytes);
         index += nbytes;
         remain -= nbytes;
         if(read_ret < 0) break;
     }
-    //read_cmd->completed_transfer_count = read_cmd->requested_transfer_count - remain;
-    [read_cmd setValue:[NSNumber numberWithInt:[[read_cmd valueForKey:@"requested_transfer_count"] intValue] - remain] forKey:@"completed_transfer_count"];
-    //read_cmd->end = end_flag;
-    [read_cmd setValue:[NSNumber numberWithBool:end_flag] forKey:@"end"];
+    read_cmd->completed_transfer_count = read_cmd->requested_transfer_count - remain;
+    read_cmd->end = end_flag;
     /* suppress errors (for example due to timeout or interruption by device clear)
      if all bytes got sent.  This prevents races that can occur in the various drivers
      if a device receives a device clear immediately after a transfer completes and
@@ -389,116 +750,148 @@
     {
         read_ret = 0;
     }
-    atomic_flag_clear(&desc->io_in_progress);
-    CFRunLoopSourceSignal(m_board->m_private_board.wait);
-    CFRunLoopWakeUp(m_board->m_private_board.runner);
+    /* the device stays talker until the bus is addressed again, unless
+     * the transfer failed and left it in any state */
+    if(read_ret < 0)
+        atomic_store(&m_addressing, 0);
+    else if(addressing)
+        [self set_addressed:desc->pad : desc->sad : YES];
+    atomic_store(&desc->io_in_progress, NO);
+    gpib_wake_board(&m_board->m_private_board);
     return read_ret;
 }
 
-//-(SInt32) command_ioctl:(read_write_ioctl_t *) cmd
--(SInt32) command_ioctl:(NSMutableDictionary *) cmd
+-(SInt32) command_ioctl:(read_write_ioctl_t *) cmd
 {
-    SInt32 remain;
+    UInt64 remain, index;
     SInt32 retval;
     gpib_descriptor *desc;
-    UInt32 bytes_written = 0, index = 0, nbytes = 0;
+    UInt32 bytes_written = 0, nbytes = 0;
     
-    //if(cmd->completed_transfer_count > cmd->requested_transfer_count)
-    if( [[cmd valueForKey:@"completed_transfer_count"] intValue] >
-        [[cmd valueForKey:@"requested_transfer_count"] intValue] )
+    if(cmd->completed_transfer_count > cmd->requested_transfer_count)
         return -EINVAL;
     
-    //desc = [self handle_to_descriptor:cmd->handle];
-    desc = [self handle_to_descriptor:[[cmd valueForKey:@"handle"] intValue]];
+    desc = [self handle_to_descriptor:cmd->handle];
     if( desc == NULL ) return -EINVAL;
     
-    //remain = cmd->requested_transfer_count - cmd->completed_transfer_count;
-    remain = [[cmd valueForKey:@"requested_transfer_count"] intValue] -
-                [[cmd valueForKey:@"completed_transfer_count"] intValue];
+    [m_board setUsecTimeout:cmd->usec_timeout];
+    
+    remain = cmd->requested_transfer_count - cmd->completed_transfer_count;
+    index = cmd->completed_transfer_count;
     
     /* Write buffer loads till we empty the user supplied buffer.
      Call drivers at least once, even if remain is zero, in
      order to allow them to insure previous commands were
      completely finished, in the case of a restarted ioctl.  */
-    atomic_flag_test_and_set(&desc->io_in_progress);
+    atomic_store(&desc->io_in_progress, YES);
     do
     {
-        nbytes =(([m_board getBufferLength] < remain) ? [m_board getBufferLength]: remain);
-        //for(int i = 0; i < (([m_board getBufferLength] < remain) ? [m_board getBufferLength]: remain) ; i++)
-        //    [m_board getBuffer][i] = cmd->buffer_ptr[i+index];
-        [[cmd valueForKey:@"buffer"] getBytes:[m_board getBuffer] range:NSMakeRange(index, nbytes)];
-        //retval = [self ibcmd:[m_board getBuffer] : (([m_board getBufferLength] < remain) ?
-        //                                               [m_board getBufferLength] : remain) : &bytes_written];
+        nbytes =(UInt32)(([m_board getBufferLength] < remain) ? [m_board getBufferLength]: remain);
+        memcpy([m_board getBuffer], cmd->buffer_ptr + index, nbytes);
         retval = [self ibcmd:[m_board getBuffer] : nbytes : &bytes_written];
         index += bytes_written;
         remain -= bytes_written;
         if(retval < 0 || bytes_written == 0)
         {
-            atomic_flag_clear(&desc->io_in_progress);
-            CFRunLoopSourceSignal(m_board->m_private_board.wait);
-            CFRunLoopWakeUp(m_board->m_private_board.runner);
+            atomic_store(&desc->io_in_progress, NO);
+            gpib_wake_board(&m_board->m_private_board);
             break;
         }
     }while( remain > 0 );
     
-    //cmd->completed_transfer_count = cmd->requested_transfer_count - remain;
-    [cmd setValue:[NSNumber numberWithInt:[[cmd valueForKey:@"requested_transfer_count"] intValue] - remain] forKey:@"completed_transfer_count"];
+    cmd->completed_transfer_count = cmd->requested_transfer_count - remain;
+    /* track_addressing forgot the addressing before the command, it is
+     * known again once the whole addressing sequence went out */
+    if( cmd->address && retval >= 0 && remain == 0 )
+        [self set_addressed:desc->pad : desc->sad : cmd->device_talks];
     
-    atomic_flag_clear(&desc->io_in_progress);
-    CFRunLoopSourceSignal(m_board->m_private_board.wait);
-    CFRunLoopWakeUp(m_board->m_private_board.runner);
+    atomic_store(&desc->io_in_progress, NO);
+    gpib_wake_board(&m_board->m_private_board);
     
     return retval;
 }
 
-//-(SInt32) write_ioctl:(read_write_ioctl_t *) write_cmd
--(SInt32) write_ioctl:(NSMutableDictionary *) write_cmd
+-(SInt32) write_ioctl:(read_write_ioctl_t *) write_cmd
 {
-    SInt32 remain;
+    UInt64 remain, index;
     SInt32 retval = 0;
     gpib_descriptor *desc;
     BOOL send_eoi;
-    UInt32 bytes_written = 0, index =0, nbytes=0;
+    gpib_descriptor *address = nil;
+    BOOL addressing;
+    UInt32 bytes_written = 0, nbytes=0, chunk_length, direct_length;
+    struct iovec segment, chunk[ GPIB_LINK_WRITE_SEGMENTS ];
+    const struct iovec *iov;
+    UInt32 iov_count, chunk_count, i, offset;
     
-    //if(write_cmd->completed_transfer_count > write_cmd->requested_transfer_count)
-    if( [[write_cmd valueForKey:@"completed_transfer_count"] intValue] >
-       [[write_cmd valueForKey:@"requested_transfer_count"] intValue] )
+    if(write_cmd->completed_transfer_count > write_cmd->requested_transfer_count)
         return -EINVAL;
     
-    //desc = [self handle_to_descriptor:write_cmd->handle];
-    desc = [self handle_to_descriptor:[[write_cmd valueForKey:@"handle"] intValue]];
+    desc = [self handle_to_descriptor:write_cmd->handle];
     if( desc == NULL ) return -EINVAL;
     
-    //remain = write_cmd->requested_transfer_count - write_cmd->completed_transfer_count;
-    remain = [[write_cmd valueForKey:@"requested_transfer_count"] intValue] -
-                [[write_cmd valueForKey:@"completed_transfer_count"] intValue];
+    [m_board setUsecTimeout:write_cmd->usec_timeout];
+    
+    remain = write_cmd->requested_transfer_count - write_cmd->completed_transfer_count;
+    index = write_cmd->completed_transfer_count;
     
-    atomic_flag_test_and_set(&desc->io_in_progress);
+    /* a plain write is a single segment */
+    if(write_cmd->iov_count)
+    {
+        iov = write_cmd->iov;
+        iov_count = write_cmd->iov_count;
+    }else
+    {
+        segment.iov_base = write_cmd->buffer_ptr;
+        segment.iov_len = (size_t) write_cmd->requested_transfer_count;
+        iov = &segment;
+        iov_count = 1;
+    }
+    
+    /* let the board address the device with the first buffer load */
+    if( write_cmd->address && desc->is_board == NO && [m_board supports_addressed_io] )
+        address = desc;
+    addressing = ( address != nil );
+    if( addressing )
+        atomic_store(&m_addressing, 0);
+    
+    /* boards that can, write straight from the user supplied buffer */
+    direct_length = [m_board direct_write_length];
+    chunk_length = direct_length ? direct_length : [m_board getBufferLength];
+    
+    atomic_store(&desc->io_in_progress, YES);
     /* Write buffer loads till we empty the user supplied buffer */
     while(remain > 0)
     {
-        nbytes =(([m_board getBufferLength] < remain) ? [m_board getBufferLength]: remain);
-        //if(remain <= [m_board getBufferLength] && write_cmd->end)
-        if(remain <= [m_board getBufferLength] && [[write_cmd valueForKey:@"send_eoi"] boolValue])
+        chunk_count = link_iovec_chunk(iov, iov_count, index, chunk, GPIB_LINK_WRITE_SEGMENTS,
+                                       (UInt32)((chunk_length < remain) ? chunk_length: remain), &nbytes);
+        if(nbytes == 0)
+        {
+            /* the segments are shorter than the requested count */
+            retval = -EINVAL;
+            break;
+        }
+        if(nbytes == remain && write_cmd->end)
             send_eoi = YES;
         else
             send_eoi = NO;
         
-        //for(int i = 0; i < (([m_board getBufferLength] < remain) ? [m_board getBufferLength] : remain) ; i++)
-        //    [m_board getBuffer][i] = write_cmd->buffer_ptr[i+index];
-        [[write_cmd valueForKey:@"buffer"] getBytes:[m_board getBuffer] range:NSMakeRange(index, nbytes)];
-        
-        //retval = [self ibwrt:[m_board getBuffer] : (([m_board getBufferLength]< remain) ?
-        //                                               [m_board getBufferLength]: remain) : send_eoi : &bytes_written];
-        retval = [self ibwrt:[m_board getBuffer] : nbytes : send_eoi : &bytes_written];
+        if(direct_length)
+            retval = [self ibwrtv:chunk : chunk_count : address : send_eoi : &bytes_written];
+        else
+        {
+            for(i = 0, offset = 0; i < chunk_count; offset += chunk[i].iov_len, i++)
+                memcpy([m_board getBuffer] + offset, chunk[i].iov_base, chunk[i].iov_len);
+            retval = [self ibwrt:[m_board getBuffer] : nbytes : address : send_eoi : &bytes_written];
+        }
+        address = nil;
         
         index += bytes_written;
         remain -= bytes_written;
         if(retval < 0 || bytes_written == 0)
             break;
     }
-    //write_cmd->completed_transfer_count = write_cmd->requested_transfer_count - remain;
-    [write_cmd setValue:[NSNumber numberWithInt:[[write_cmd valueForKey:@"requested_transfer_count"] intValue] - remain] forKey:@"completed_transfer_count"];
+    write_cmd->completed_transfer_count = write_cmd->requested_transfer_count - remain;
     /* suppress errors (for example due to timeout or interruption by device clear)
      if all bytes got sent.  This prevents races that can occur in the various drivers
      if a device receives a device clear immediately after a transfer completes and
@@ -506,9 +899,14 @@
      */
     if(remain == 0)
         retval = 0;
-    atomic_flag_clear(&desc->io_in_progress);
-    CFRunLoopSourceSignal(m_board->m_private_board.wait);
-    CFRunLoopWakeUp(m_board->m_private_board.runner);
+    /* the device stays listener until the bus is addressed again, unless
+     * the transfer failed and left it in any state */
+    if(retval < 0)
+        atomic_store(&m_addressing, 0);
+    else if(addressing)
+        [self set_addressed:desc->pad : desc->sad : NO];
+    atomic_store(&desc->io_in_progress, NO);
+    gpib_wake_board(&m_board->m_private_board);
     return retval;
 }
 
@@ -546,8 +944,8 @@
         desc->sad = sad;
         desc->is_board = is_board;
         [m_descriptors addObject:desc];
-        pthread_mutex_unlock(&m_descriptors_mutex);
         *handle = (unsigned int)[m_descriptors count] - 1;
+        pthread_mutex_unlock(&m_descriptors_mutex);
         retval = [m_board increment_open_device_count:pad : sad];
         if( retval < 0 )
             return retval;
@@ -564,7 +962,10 @@
     
     retval = [m_board decrement_open_device_count:desc->pad : desc->sad];
     if( retval < 0 ) return retval;
+    if(pthread_mutex_lock(&m_descriptors_mutex))
+        return -ERESTARTSYS;
     [m_descriptors removeObjectAtIndex:handle];
+    pthread_mutex_unlock(&m_descriptors_mutex);
     //[desc release];
     
     return 0;
@@ -582,25 +983,69 @@
     return 0;
 }
 
-//-(int) wait_ioctl:(wait_ioctl_t*) wait_cmd
--(int) wait_ioctl:(NSDictionary*) wait_cmd
+/* Serial polls a list of devices with a single ioctl.  Status bytes already
+ * queued by autopolling are returned first, the other devices are polled
+ * in runs with serial_poll_list. */
+-(int) serial_poll_list_ioctl:(serial_poll_list_ioctl_t *) poll_cmd
+{
+    const UInt16 *pads = poll_cmd->pads;
+    const SInt16 *sads = poll_cmd->sads;
+    UInt8 *results = poll_cmd->results;
+    UInt32 num_devices = poll_cmd->requested_transfer_count;
+    unsigned int usec_timeout = poll_cmd->usec_timeout;
+    BOOL stop_on_rqs = poll_cmd->stop_on_rqs;
+    UInt32 index, run, num_polled;
+    gpib_status_queue *device;
+    int retval = 0;
+    
+    GPIB_DPRINTK( "entering serial_poll_list_ioctl()\n" );
+    
+    poll_cmd->completed_transfer_count = 0;
+    if( num_devices && ( pads == NULL || sads == NULL || results == NULL ) )
+        return -EINVAL;
+    
+    index = 0;
+    while( index < num_devices )
+    {
+        device = [m_board get_gpib_status_queue:pads[index] : sads[index]];
+        if( [m_board num_status_bytes:device] )
+        {
+            retval = [m_board pop_status_byte:device : &results[index]];
+            if( retval < 0 ) break;
+            index++;
+            if( stop_on_rqs && ( results[index - 1] & request_service_bit ) ) break;
+            continue;
+        }
+        for( run = 1; index + run < num_devices; run++ )
+        {
+            device = [m_board get_gpib_status_queue:pads[index + run] : sads[index + run]];
+            if( [m_board num_status_bytes:device] ) break;
+        }
+        retval = [self serial_poll_list:pads + index : sads + index : run : stop_on_rqs : usec_timeout :
+                  results + index : &num_polled];
+        index += num_polled;
+        if( retval < 0 ) break;
+        if( stop_on_rqs && num_polled > 0 && ( results[index - 1] & request_service_bit ) ) break;
+    }
+    poll_cmd->completed_transfer_count = index;
+    
+    return retval;
+}
+
+-(int) wait_ioctl:(wait_ioctl_t*) wait_cmd
 {
     int retval;
     gpib_descriptor *desc;
-    SInt32 ibsta = [[wait_cmd valueForKey:@"ibsta"] intValue];
     
-    //desc = [self handle_to_descriptor:wait_cmd->handle];
-    desc = [self handle_to_descriptor:[[wait_cmd valueForKey:@"handle"] intValue] ];
+    desc = [self handle_to_descriptor:wait_cmd->handle];
     if( desc == NULL ) return -EINVAL;
     
-    //retval = [self ibwait:wait_cmd->wait_mask : wait_cmd->clear_mask :
-    //          wait_cmd->set_mask : &wait_cmd->ibsta : wait_cmd->usec_timeout : desc];
-    retval = [self ibwait:[[wait_cmd valueForKey:@"wait_mask"] intValue] :
-                [[wait_cmd valueForKey:@"clear_mask"] intValue] :
-                [[wait_cmd valueForKey:@"set_mask"] intValue] :
-                &ibsta : [[wait_cmd valueForKey:@"usec_timeout"] intValue] : desc];
-    [wait_cmd setValue:[NSNumber numberWithInt:ibsta] forKey:@"ibsta"];
+    retval = [self ibwait:wait_cmd->wait_mask : wait_cmd->clear_mask :
+              wait_cmd->set_mask : &wait_cmd->ibsta : wait_cmd->usec_timeout : desc];
     
+    /* another controller in charge may have addressed the bus meanwhile */
+    if( retval < 0 || ( wait_cmd->ibsta & CIC ) == 0 )
+        atomic_store(&m_addressing, 0);
     if( retval < 0 ) return retval;
     
     return 0;
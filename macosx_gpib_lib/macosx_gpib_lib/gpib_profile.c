@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+#include <stdatomic.h>
+#include <time.h>
+#include "gpib_profile.h"
+
+static _Atomic uint64_t profile_nsec[ GPIB_PROFILE_NUM_LAYERS ];
+static _Atomic uint64_t profile_calls[ GPIB_PROFILE_NUM_LAYERS ];
+
+uint64_t gpib_profile_clock( void )
+{
+	struct timespec now;
+
+	clock_gettime( CLOCK_MONOTONIC, &now );
+	return ( uint64_t ) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void gpib_profile_add( int layer, uint64_t nsec )
+{
+	if( layer < 0 || layer >= GPIB_PROFILE_NUM_LAYERS ) return;
+	atomic_fetch_add_explicit( &profile_nsec[ layer ], nsec, memory_order_relaxed );
+	atomic_fetch_add_explicit( &profile_calls[ layer ], 1, memory_order_relaxed );
+}
+
+void gpib_profile_reset( void )
+{
+	int i;
+
+	for( i = 0; i < GPIB_PROFILE_NUM_LAYERS; i++ )
+	{
+		atomic_store( &profile_nsec[ i ], 0 );
+		atomic_store( &profile_calls[ i ], 0 );
+	}
+}
+
+void gpib_profile_read( uint64_t nsec[ GPIB_PROFILE_NUM_LAYERS ], uint64_t calls[ GPIB_PROFILE_NUM_LAYERS ] )
+{
+	int i;
+
+	for( i = 0; i < GPIB_PROFILE_NUM_LAYERS; i++ )
+	{
+		nsec[ i ] = atomic_load( &profile_nsec[ i ] );
+		calls[ i ] = atomic_load( &profile_calls[ i ] );
+	}
+}
+
+int gpib_profile_enabled( void )
+{
+#ifdef GPIB_PROFILE
+	return 1;
+#else
+	return 0;
+#endif
+}
@@ -0,0 +1,54 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+#ifndef _GPIB_PROFILE_H
+#define _GPIB_PROFILE_H
+
+#include <stdint.h>
+
+/* Per layer time counters, only updated when the library is built with
+ * -DGPIB_PROFILE.  The times are inclusive: the link time contains the
+ * ioctl time which contains the board time. */
+enum gpib_profile_layer
+{
+    GPIB_PROFILE_LINK = 0,	/* gpib_link -ioctl:, caller side, thread hop included */
+    GPIB_PROFILE_IOCTL = 1,	/* gpib_link -ibioctl:, on the link thread */
+    GPIB_PROFILE_BOARD = 2,	/* gpib_board driver calls made by gpib_sys */
+    GPIB_PROFILE_NUM_LAYERS = 3
+};
+
+#ifdef GPIB_PROFILE
+#define GPIB_PROFILE_START( start ) uint64_t start = gpib_profile_clock()
+#define GPIB_PROFILE_STOP( layer, start ) gpib_profile_add( layer, gpib_profile_clock() - start )
+#else
+#define GPIB_PROFILE_START( start )
+#define GPIB_PROFILE_STOP( layer, start )
+#endif
+
+/* monotonic clock in nanoseconds */
+uint64_t gpib_profile_clock( void );
+void gpib_profile_add( int layer, uint64_t nsec );
+void gpib_profile_reset( void );
+/* copies the accumulated nanoseconds and number of calls of each layer */
+void gpib_profile_read( uint64_t nsec[ GPIB_PROFILE_NUM_LAYERS ], uint64_t calls[ GPIB_PROFILE_NUM_LAYERS ] );
+/* returns 1 if the counters are compiled in */
+int gpib_profile_enabled( void );
+
+#endif	/* _GPIB_PROFILE_H */
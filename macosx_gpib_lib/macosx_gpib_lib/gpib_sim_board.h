@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+#import "gpib_board.h"
+
+/* number of bytes of each received message kept by an instrument, the
+ * rest of a long message is counted but discarded */
+#define GPIB_SIM_MAX_MESSAGE 0x1000
+/* buffer length of the simulated interface, same as the 82357 maximum */
+#define GPIB_SIM_BUFFER_LENGTH 0x4000
+
+/* An instrument living on the simulated bus.
+ * A message received as listener is terminated by EOI or a newline. When
+ * the message is a query (last non blank character is '?') the instrument
+ * queues its answer: 'response' if set, an IEEE 488.2 definite length block
+ * of 'blockLength' bytes if set, otherwise an echo of the query.
+ * The answer is made available to the controller 'latencyUsec' after the
+ * first read attempt and its last byte is sent with EOI.
+ * If 'srqPeriodUsec' is not zero the instrument asserts SRQ periodically,
+ * if 'srqOnMessage' is set it asserts SRQ (and MAV) when an answer is queued.
+ * SRQ is released when the instrument is serial polled.
+ * Instruments must be configured before the board is brought online, the
+ * simulated board only touches them from its own thread afterwards.
+ */
+@interface gpib_sim_instrument : NSObject
+{
+@protected
+    NSMutableData *m_input;
+    UInt8 m_last_char;
+    NSData *m_out_header;
+    UInt64 m_out_payload_length;
+    NSData *m_out_trailer;
+    UInt64 m_out_offset;
+    BOOL m_out_pending;
+    BOOL m_latency_pending;
+    CFRunLoopTimerRef m_srq_timer;
+    private_board *m_board;
+@public
+    BOOL listening;
+    BOOL talking;
+}
+
+/* primary address */
+@property(getter=getPad) UInt8 pad;
+/* secondary address (negative means disabled) */
+@property(getter=getSad) SInt8 sad;
+/* delay before the first byte of an answer is available */
+@property(getter=getLatencyUsec) UInt32 latencyUsec;
+/* fixed answer to every query */
+@property(copy) NSData *response;
+/* payload length of the binary block sent as answer to every query */
+@property(getter=getBlockLength) UInt64 blockLength;
+/* period of the SRQ assertions, 0 disables */
+@property(getter=getSrqPeriodUsec) UInt32 srqPeriodUsec;
+/* assert SRQ when an answer is queued */
+@property(getter=getSrqOnMessage) BOOL srqOnMessage;
+/* serial poll status byte */
+@property(getter=getStatusByte) UInt8 statusByte;
+/* statistics, updated on the board thread */
+@property(readonly) UInt64 bytesReceived;
+@property(readonly) UInt64 messagesReceived;
+
+-(id) init_gpib_sim_instrument:(UInt8) pad : (SInt8) sad;
+-(void) attach_board:(private_board *) board;
+-(void) detach_board;
+-(BOOL) is_requesting_service;
+-(void) request_service;
+-(UInt8) serial_poll;
+-(void) device_clear;
+-(void) trigger;
+-(void) listen:(const UInt8 *) buffer : (UInt32) length : (BOOL) eoi;
+-(BOOL) has_output;
+-(BOOL) take_latency;
+-(UInt32) talk:(UInt8 *) buffer : (UInt32) length : (SInt32) eos : (UInt8) eos_mask : (BOOL *) end;
+
+@end
+
+/* gpib_board emulating an IEEE 488 bus in memory.
+ * Commands sent with ATN are decoded to track talker/listener addressing,
+ * serial poll mode and device clear/trigger.  Data written by the board
+ * goes to the addressed listeners and reads are served by the addressed
+ * talker.  Like the 82357 firmware it can address the device itself as
+ * part of a read or write.  There is a single simulated bus, so a single
+ * board can be attached.  Selected with the GPIB_BOARD_CLASS=gpib_sim_board
+ * environment variable or +[gpib_visa_internal set_board_class:].
+ */
+@interface gpib_sim_board : gpib_board {
+@private
+    NSArray *m_instruments;
+    gpib_sim_instrument *m_talker;
+    SInt32 m_last_primary;
+    UInt8 m_eos_char;
+    UInt16 m_eos_mode;
+    UInt8 m_spoll_status;
+    BOOL m_attached;
+    BOOL m_is_cic;
+    BOOL m_atn;
+    BOOL m_ren;
+    BOOL m_spoll;
+    BOOL m_talk_addressed;
+    BOOL m_listen_addressed;
+}
+
+/* instruments put on the bus when the board is attached */
++(void) add_instrument:(gpib_sim_instrument *) instrument;
++(void) remove_all_instruments;
++(NSArray *) instruments;
+
+@end
@@ -0,0 +1,849 @@
+/*
+ * Copyright (c) 2004 Frank Mori Hess (fmhess@users.sourceforge.net)
+ * Copyright (c) 2018 Guilhem Vavelin (guileukow@users.sourceforge.net)
+ *
+ *    This source code is free software; you can redistribute it
+ *    and/or modify it in source code form under the terms of the GNU
+ *    General Public License as published by the Free Software
+ *    Foundation; either version 2 of the License, or (at your option)
+ *    any later version.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU General Public License for more details.
+ *
+ *    You should have received a copy of the GNU General Public License
+ *    along with this program; if not, write to the Free Software
+ *    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA
+ */
+
+#import "gpib_sim_board.h"
+#import "gpib_eos.h"
+
+/* instruments registered for the simulated bus */
+static NSMutableArray *sim_instruments = nil;
+/* there is only one simulated bus, so only one board can be attached */
+static BOOL sim_board_attached = NO;
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * \brief  Callback function for the periodic SRQ timer of an instrument
+ */
+static void srq_timer_fire(CFRunLoopTimerRef timer, void *info)
+{
+    gpib_sim_instrument *instrument = (__bridge gpib_sim_instrument *) info;
+    [instrument request_service];
+}
+
+@implementation gpib_sim_instrument
+
+-(id) init_gpib_sim_instrument:(UInt8) pad : (SInt8) sad
+{
+    self = [super init];
+    m_input = [[NSMutableData alloc] initWithCapacity:GPIB_SIM_MAX_MESSAGE];
+    m_last_char = 0;
+    m_out_header = nil;
+    m_out_payload_length = 0;
+    m_out_trailer = nil;
+    m_out_offset = 0;
+    m_out_pending = NO;
+    m_latency_pending = NO;
+    m_srq_timer = 0;
+    m_board = NULL;
+    listening = NO;
+    talking = NO;
+    _pad = pad;
+    _sad = sad;
+    _latencyUsec = 0;
+    _response = nil;
+    _blockLength = 0;
+    _srqPeriodUsec = 0;
+    _srqOnMessage = NO;
+    _statusByte = 0;
+    _bytesReceived = 0;
+    _messagesReceived = 0;
+    return self;
+}
+
+-(void) attach_board:(private_board *) board
+{
+    m_board = board;
+    listening = NO;
+    talking = NO;
+    [self device_clear];
+    if(_srqPeriodUsec > 0 && m_srq_timer == 0)
+    {
+        CFRunLoopTimerContext context = { 0, (__bridge void *) self, NULL, NULL, NULL };
+        CFTimeInterval period = _srqPeriodUsec / 1.0e6;
+        m_srq_timer = CFRunLoopTimerCreate(NULL, CFAbsoluteTimeGetCurrent() + period, period, 0, 0, srq_timer_fire, &context);
+        if(m_srq_timer != 0)
+            CFRunLoopAddTimer(CFRunLoopGetCurrent(), m_srq_timer, kCFRunLoopCommonModes);
+    }
+}
+
+-(void) detach_board
+{
+    if(m_srq_timer != 0)
+    {
+        if(CFRunLoopTimerIsValid(m_srq_timer))
+            CFRunLoopTimerInvalidate(m_srq_timer);
+        CFRelease(m_srq_timer);
+        m_srq_timer = 0;
+    }
+    m_board = NULL;
+}
+
+-(BOOL) is_requesting_service
+{
+    if(_statusByte & request_service_bit)
+        return YES;
+    return NO;
+}
+
+-(void) request_service
+{
+    _statusByte |= request_service_bit;
+    if(m_board != NULL)
+    {
+        [gpib_board set_bit:SRQI_NUM : &m_board->status];
+        gpib_wake_board(m_board);
+    }
+}
+
+/* returns the status byte and releases SRQ */
+-(UInt8) serial_poll
+{
+    UInt8 status = _statusByte;
+    _statusByte &= ~request_service_bit;
+    return status;
+}
+
+-(void) device_clear
+{
+    [m_input setLength:0];
+    m_last_char = 0;
+    m_out_pending = NO;
+    m_latency_pending = NO;
+    _statusByte &= ~IbStbMAV;
+}
+
+-(void) trigger
+{
+    /* the simulated instruments have no measurement to start */
+    return;
+}
+
+-(void) store_input:(const UInt8 *) buffer : (UInt32) length
+{
+    UInt32 kept = (UInt32)[m_input length];
+    SInt32 i;
+
+    if(kept < GPIB_SIM_MAX_MESSAGE)
+        [m_input appendBytes:buffer length:MIN(length, GPIB_SIM_MAX_MESSAGE - kept)];
+    for(i = (SInt32) length - 1; i >= 0; i--)
+    {
+        if(isspace(buffer[i]) == 0)
+        {
+            m_last_char = buffer[i];
+            break;
+        }
+    }
+}
+
+-(void) queue_answer
+{
+    char header[24];
+
+    m_out_payload_length = 0;
+    m_out_trailer = nil;
+    if(_response != nil)
+    {
+        m_out_header = _response;
+    }
+    else if(_blockLength > 0)
+    {
+        /* IEEE 488.2 definite length arbitrary block: #<digits><length><payload> */
+        int digits = snprintf(header + 2, sizeof(header) - 2, "%llu", (unsigned long long) _blockLength);
+        header[0] = '#';
+        header[1] = '0' + digits;
+        m_out_header = [[NSData alloc] initWithBytes:header length:digits + 2];
+        m_out_payload_length = _blockLength;
+        m_out_trailer = [[NSData alloc] initWithBytes:"\n" length:1];
+    }
+    else
+    {
+        m_out_header = [[NSData alloc] initWithData:m_input];
+    }
+    m_out_offset = 0;
+    m_out_pending = YES;
+    m_latency_pending = YES;
+    if(_srqOnMessage)
+    {
+        _statusByte |= IbStbMAV;
+        [self request_service];
+    }
+}
+
+-(void) end_of_message
+{
+    _messagesReceived++;
+    if(m_last_char == '?')
+        [self queue_answer];
+    [m_input setLength:0];
+    m_last_char = 0;
+}
+
+/* data bytes sent to the instrument while it is addressed as listener */
+-(void) listen:(const UInt8 *) buffer : (UInt32) length : (BOOL) eoi
+{
+    UInt32 start = 0, stop;
+    const UInt8 *newline;
+
+    while(start < length)
+    {
+        newline = memchr(buffer + start, '\n', length - start);
+        if(newline != NULL)
+            stop = (UInt32)(newline - buffer) + 1;
+        else
+            stop = length;
+        [self store_input:buffer + start : stop - start];
+        if(newline != NULL || eoi)
+            [self end_of_message];
+        start = stop;
+    }
+    _bytesReceived += length;
+}
+
+-(BOOL) has_output
+{
+    return m_out_pending;
+}
+
+/* returns YES once per answer, the first time the controller reads it */
+-(BOOL) take_latency
+{
+    BOOL pending = m_latency_pending;
+    m_latency_pending = NO;
+    return pending;
+}
+
+/* data bytes sent by the instrument while it is addressed as talker.
+ * 'eos' is negative when reads do not end on an EOS character.
+ */
+-(UInt32) talk:(UInt8 *) buffer : (UInt32) length : (SInt32) eos : (UInt8) eos_mask : (BOOL *) end
+{
+    UInt64 header_length = [m_out_header length];
+    UInt64 trailer_length = [m_out_trailer length];
+    UInt64 total = header_length + m_out_payload_length + trailer_length;
+    UInt64 position;
+    UInt32 count = 0, chunk, i;
+    ssize_t eos_index;
+    BOOL eos_found = NO;
+
+    *end = NO;
+    while(count < length && m_out_offset < total)
+    {
+        if(m_out_offset < header_length)
+        {
+            chunk = (UInt32) MIN(length - count, header_length - m_out_offset);
+            memcpy(buffer + count, (const UInt8 *)[m_out_header bytes] + m_out_offset, chunk);
+        }
+        else if(m_out_offset < header_length + m_out_payload_length)
+        {
+            position = m_out_offset - header_length;
+            chunk = (UInt32) MIN(length - count, m_out_payload_length - position);
+            for(i = 0; i < chunk; i++)
+                buffer[count + i] = (UInt8)(position + i);
+        }
+        else
+        {
+            position = m_out_offset - header_length - m_out_payload_length;
+            chunk = (UInt32) MIN(length - count, trailer_length - position);
+            memcpy(buffer + count, (const UInt8 *)[m_out_trailer bytes] + position, chunk);
+        }
+        if(eos >= 0)
+        {
+            eos_index = gpib_find_eos(buffer + count, chunk, eos, eos_mask == 0xff);
+            if(eos_index >= 0)
+            {
+                chunk = (UInt32) eos_index + 1;
+                eos_found = YES;
+            }
+        }
+        count += chunk;
+        m_out_offset += chunk;
+        if(eos_found)
+        {
+            *end = YES;
+            break;
+        }
+    }
+    if(m_out_offset >= total)
+    {
+        /* last byte is sent with EOI */
+        *end = YES;
+        m_out_pending = NO;
+        _statusByte &= ~IbStbMAV;
+    }
+    return count;
+}
+
+@end
+
+@implementation gpib_sim_board
+
++(void) add_instrument:(gpib_sim_instrument *) instrument
+{
+    pthread_mutex_lock(&sim_lock);
+    if(sim_instruments == nil)
+        sim_instruments = [[NSMutableArray alloc] init];
+    [sim_instruments addObject:instrument];
+    pthread_mutex_unlock(&sim_lock);
+}
+
++(void) remove_all_instruments
+{
+    pthread_mutex_lock(&sim_lock);
+    [sim_instruments removeAllObjects];
+    pthread_mutex_unlock(&sim_lock);
+}
+
++(NSArray *) instruments
+{
+    NSArray *instruments;
+    pthread_mutex_lock(&sim_lock);
+    instruments = [[NSArray alloc] initWithArray:sim_instruments];
+    pthread_mutex_unlock(&sim_lock);
+    return instruments;
+}
+
+-(void) unaddress_all
+{
+    gpib_sim_instrument *instrument;
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        instrument->listening = NO;
+        instrument->talking = NO;
+    }
+    m_talker = nil;
+    m_last_primary = -1;
+    m_spoll = NO;
+    m_talk_addressed = NO;
+    m_listen_addressed = NO;
+}
+
+-(void) untalk_all
+{
+    gpib_sim_instrument *instrument;
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        instrument->talking = NO;
+    }
+    m_talker = nil;
+    m_talk_addressed = NO;
+}
+
+-(void) unlisten_all
+{
+    gpib_sim_instrument *instrument;
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        instrument->listening = NO;
+    }
+    m_listen_addressed = NO;
+}
+
+-(BOOL) srq_asserted
+{
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        if([[m_instruments objectAtIndex:index] is_requesting_service])
+            return YES;
+    }
+    return NO;
+}
+
+-(BOOL) has_listener
+{
+    gpib_sim_instrument *instrument;
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        if(instrument->listening)
+            return YES;
+    }
+    return NO;
+}
+
+/* talk or listen address, 'sad' is negative for a primary address */
+-(void) address:(UInt8) primary : (SInt32) sad
+{
+    gpib_sim_instrument *instrument;
+    UInt8 pad = primary & 0x1f;
+    BOOL talk = (primary & TAD) ? YES : NO;
+
+    if(talk)
+        [self untalk_all];
+    if(pad == [self getPad])
+    {
+        if(talk)
+            m_talk_addressed = YES;
+        else
+            m_listen_addressed = YES;
+    }
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        if(gpib_address_equal([instrument getPad], [instrument getSad], pad, sad) == 0)
+            continue;
+        if(talk)
+        {
+            instrument->talking = YES;
+            m_talker = instrument;
+        }
+        else
+            instrument->listening = YES;
+    }
+}
+
+-(void) decode_command:(UInt8) command
+{
+    gpib_sim_instrument *instrument;
+
+    switch(command)
+    {
+        case UNL:
+            [self unlisten_all];
+            m_last_primary = -1;
+            break;
+        case UNT:
+            [self untalk_all];
+            m_last_primary = -1;
+            break;
+        case SPE:
+            m_spoll = YES;
+            break;
+        case SPD:
+            m_spoll = NO;
+            break;
+        case DCL:
+            for(int index = 0; index < [m_instruments count]; index ++)
+                [[m_instruments objectAtIndex:index] device_clear];
+            break;
+        case SDC:
+        case GET:
+            for(int index = 0; index < [m_instruments count]; index ++)
+            {
+                instrument = [m_instruments objectAtIndex:index];
+                if(instrument->listening == NO)
+                    continue;
+                if(command == SDC)
+                    [instrument device_clear];
+                else
+                    [instrument trigger];
+            }
+            break;
+        default:
+            if((command & 0x60) == LAD || (command & 0x60) == TAD)
+            {
+                m_last_primary = command;
+                [self address:command : -1];
+            }
+            else if((command & 0x60) == SAD && (command & 0x1f) <= gpib_addr_max && m_last_primary >= 0)
+            {
+                [self address:m_last_primary : command & 0x1f];
+            }
+            /* other commands (GTL, LLO, PPC, TCT...) are ignored */
+            break;
+    }
+}
+
+/* block as the hardware would, running the run loop so that the
+ * watchdog and the SRQ timers keep firing */
+-(SInt32) bus_delay:(UInt32) usec_delay
+{
+    CFAbsoluteTime deadline = CFAbsoluteTimeGetCurrent() + usec_delay / 1.0e6;
+    CFTimeInterval remaining;
+
+    while((remaining = deadline - CFAbsoluteTimeGetCurrent()) > 0)
+    {
+        if([self io_timed_out])
+            return -ETIMEDOUT;
+        CFRunLoopRunInMode(kCFRunLoopDefaultMode, remaining, YES);
+    }
+    if([self io_timed_out])
+        return -ETIMEDOUT;
+    return 0;
+}
+
+/* nobody will ever complete the handshake, wait for the watchdog */
+-(SInt32) bus_hang
+{
+    if(m_timer == 0)
+        return -ETIMEDOUT;
+    while([self io_timed_out] == NO && CFRunLoopTimerIsValid(m_timer))
+        CFRunLoopRunInMode(kCFRunLoopDefaultMode, 1.0, YES);
+    return -ETIMEDOUT;
+}
+
+// interface functions
+-(SInt32) read:(UInt8 *) buffer : (UInt32) length : (BOOL *) end : (UInt32 *) nbytes_read
+{
+    SInt32 retval;
+    SInt32 eos = -1;
+
+    *nbytes_read = 0;
+    *end = NO;
+    if(m_talker == nil || m_listen_addressed == NO)
+        return [self bus_hang];
+    if(m_spoll)
+    {
+        buffer[0] = [m_talker serial_poll];
+        *nbytes_read = 1;
+        if([self srq_asserted] == NO)
+            [gpib_board clear_bit:SRQI_NUM : &m_private_board.status];
+        return 0;
+    }
+    if([m_talker has_output] == NO)
+        return [self bus_hang];
+    if([m_talker take_latency])
+    {
+        retval = [self bus_delay:[m_talker getLatencyUsec]];
+        if(retval < 0)
+            return retval;
+    }
+    if(m_eos_mode & REOS)
+        eos = m_eos_char;
+    *nbytes_read = [m_talker talk:buffer : length : eos : (m_eos_mode & BIN) ? 0xff : 0x7f : end];
+    return 0;
+}
+
+-(SInt32) write:(UInt8 *) buffer : (UInt32) length : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    gpib_sim_instrument *instrument;
+    BOOL found = NO;
+
+    *bytes_written = 0;
+    if(m_talk_addressed == NO)
+        return -EIO;
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        if(instrument->listening == NO)
+            continue;
+        [instrument listen:buffer : length : send_eoi];
+        found = YES;
+    }
+    /* no listener, nobody releases NDAC */
+    if(found == NO)
+        return -EIO;
+    *bytes_written = length;
+    return 0;
+}
+
+-(BOOL) supports_addressed_io
+{
+    return YES;
+}
+
+/* addressing done by the interface itself, as the 82357 firmware does */
+-(SInt32) address_device:(UInt16) pad : (SInt16) sad : (BOOL) talk
+{
+    UInt8 cmdString[6];
+    UInt32 i = 0, bytes_written;
+
+    cmdString[ i++ ] = UNL;
+    cmdString[ i++ ] = talk ? MLA( [self getPad] ) : MTA( [self getPad] );
+    if( [self getSad] >= 0 )
+        cmdString[ i++ ] = MSA( [self getSad] );
+    cmdString[ i++ ] = talk ? MTA( pad ) : MLA( pad );
+    if( sad >= 0 )
+        cmdString[ i++ ] = MSA( sad );
+    return [self command:cmdString : i : &bytes_written];
+}
+
+-(SInt32) addressed_read:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL *) end : (UInt32 *) nbytes_read
+{
+    SInt32 retval;
+
+    *nbytes_read = 0;
+    *end = NO;
+    retval = [self address_device:pad : sad : YES];
+    if(retval < 0)
+        return retval;
+    m_atn = NO;
+    return [self read:buffer : length : end : nbytes_read];
+}
+
+-(SInt32) addressed_write:(UInt8 *) buffer : (UInt32) length : (UInt16) pad : (SInt16) sad : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    SInt32 retval;
+
+    *bytes_written = 0;
+    retval = [self address_device:pad : sad : NO];
+    if(retval < 0)
+        return retval;
+    m_atn = NO;
+    return [self write:buffer : length : send_eoi : bytes_written];
+}
+
+-(BOOL) supports_serial_poll
+{
+    return YES;
+}
+
+-(UInt32) direct_read_length
+{
+    return GPIB_SIM_BUFFER_LENGTH;
+}
+
+-(UInt32) direct_write_length
+{
+    return GPIB_SIM_BUFFER_LENGTH;
+}
+
+-(SInt32) addressed_serial_poll:(UInt16) pad : (SInt16) sad : (UInt8 *) status_byte
+{
+    UInt8 cmdString[4];
+    UInt32 i = 0, bytes_written, nbytes_read;
+    SInt32 retval, cleanup_retval;
+    BOOL end;
+
+    retval = [self address_device:pad : sad : YES];
+    if(retval < 0)
+        return retval;
+    cmdString[ i++ ] = SPE;
+    retval = [self command:cmdString : i : &bytes_written];
+    if(retval < 0)
+        return retval;
+    m_atn = NO;
+    retval = [self read:status_byte : 1 : &end : &nbytes_read];
+    i = 0;
+    cmdString[ i++ ] = SPD;
+    cmdString[ i++ ] = UNT;
+    cleanup_retval = [self command:cmdString : i : &bytes_written];
+    if(retval == 0)
+        retval = cleanup_retval;
+    if(retval < 0)
+        return retval;
+    if(nbytes_read < 1)
+        return -EIO;
+    return 0;
+}
+
+-(SInt32) command:(UInt8 *)buffer : (UInt32) length : (UInt32 *) bytes_written
+{
+    *bytes_written = 0;
+    if(m_is_cic == NO)
+        return -EIO;
+    m_atn = YES;
+    for(UInt32 i = 0; i < length; i++)
+        [self decode_command:buffer[i] & 0x7f];
+    *bytes_written = length;
+    return 0;
+}
+
+-(SInt32) take_control:(BOOL) synchronous
+{
+    if(m_is_cic == NO)
+        return -EIO;
+    m_atn = YES;
+    return 0;
+}
+
+-(SInt32) go_to_standby
+{
+    if(m_is_cic == NO)
+        return -EIO;
+    m_atn = NO;
+    return 0;
+}
+
+-(SInt32) request_system_control:(BOOL) request_control
+{
+    if(request_control == NO)
+    {
+        m_is_cic = NO;
+        m_atn = NO;
+    }
+    return 0;
+}
+
+-(SInt32) interface_clear:(BOOL) assert
+{
+    if(assert)
+    {
+        [self unaddress_all];
+        m_is_cic = YES;
+        m_atn = YES;
+    }
+    return 0;
+}
+
+-(SInt32) remote_enable:(BOOL) enable
+{
+    m_ren = enable;
+    return 0;
+}
+
+-(SInt32) enable_eos:(UInt8) eos_byte : (BOOL) compare_8_bits
+{
+    m_eos_char = eos_byte;
+    m_eos_mode = REOS;
+    if(compare_8_bits)
+        m_eos_mode |= BIN;
+    return 0;
+}
+
+-(void) disable_eos
+{
+    m_eos_mode &= ~REOS;
+}
+
+-(UInt32) update_status:(UInt32) clear_mask
+{
+    UInt32 status;
+
+    m_private_board.status &= ~clear_mask;
+    status = m_private_board.status;
+    if(m_is_cic)
+        [gpib_board set_bit:CIC_NUM : &status];
+    else
+        [gpib_board clear_bit:CIC_NUM : &status];
+    if(m_atn)
+        [gpib_board set_bit:ATN_NUM : &status];
+    else
+        [gpib_board clear_bit:ATN_NUM : &status];
+    if(m_talk_addressed)
+        [gpib_board set_bit:TACS_NUM : &status];
+    else
+        [gpib_board clear_bit:TACS_NUM : &status];
+    if(m_listen_addressed)
+        [gpib_board set_bit:LACS_NUM : &status];
+    else
+        [gpib_board clear_bit:LACS_NUM : &status];
+    if([self srq_asserted])
+        [gpib_board set_bit:SRQI_NUM : &status];
+    else
+        [gpib_board clear_bit:SRQI_NUM : &status];
+    return status;
+}
+
+-(SInt32) primary_address:(UInt16) address
+{
+    return 0;
+}
+
+-(void) secondary_address:(UInt16) address : (BOOL) enable
+{
+    return;
+}
+
+-(SInt32) parallel_poll:(UInt8 *) result
+{
+    /* simulated instruments are not configured for parallel poll */
+    *result = 0;
+    return 0;
+}
+
+-(void) parallel_poll_configure:(UInt8) config
+{
+    //board can only be system controller
+    return;
+}
+
+-(void) parallel_poll_response:(UInt32) ist
+{
+    //board can only be system controller
+    return;
+}
+
+-(void) serial_poll_response:(UInt8) status
+{
+    m_spoll_status = status;
+}
+
+-(UInt8) serial_poll_status
+{
+    return m_spoll_status;
+}
+
+-(void) return_to_local
+{
+    //board can only be system controller
+    return;
+}
+
+-(SInt32) line_status
+{
+    SInt32 status = ValidALL;
+
+    if(m_ren)
+        status |= BusREN;
+    if(m_atn)
+        status |= BusATN;
+    if([self srq_asserted])
+        status |= BusSRQ;
+    if([self has_listener])
+        status |= BusNDAC;
+    return status;
+}
+
+-(UInt32) t1_delay:(UInt32) nanosec
+{
+    return nanosec;
+}
+
+-(SInt32) attach
+{
+    gpib_sim_instrument *instrument;
+
+    pthread_mutex_lock(&sim_lock);
+    if(sim_board_attached)
+    {
+        pthread_mutex_unlock(&sim_lock);
+        return -ENODEV;
+    }
+    sim_board_attached = YES;
+    m_instruments = [[NSArray alloc] initWithArray:sim_instruments];
+    pthread_mutex_unlock(&sim_lock);
+    m_attached = YES;
+    m_name = @"Simulated GPIB board";
+    m_eos_char = 0;
+    m_eos_mode = 0;
+    m_spoll_status = 0;
+    m_is_cic = NO;
+    m_atn = NO;
+    m_ren = NO;
+    [self gpib_allocate_board:GPIB_SIM_BUFFER_LENGTH];
+    [self unaddress_all];
+    for(int index = 0; index < [m_instruments count]; index ++)
+    {
+        instrument = [m_instruments objectAtIndex:index];
+        [instrument attach_board:&m_private_board];
+    }
+    GPIB_DPRINTK("%s: attached with %lu instruments\n", __FUNCTION__, (unsigned long)[m_instruments count]);
+    return 0;
+}
+
+-(void) detach
+{
+    if(m_attached == NO)
+        return;
+    for(int index = 0; index < [m_instruments count]; index ++)
+        [[m_instruments objectAtIndex:index] detach_board];
+    m_instruments = nil;
+    m_talker = nil;
+    m_attached = NO;
+    pthread_mutex_lock(&sim_lock);
+    sim_board_attached = NO;
+    pthread_mutex_unlock(&sim_lock);
+    [self gpib_deallocate_board];
+    GPIB_DPRINTK("%s: detached\n", __FUNCTION__);
+}
+
+@end
@@ -19,6 +19,7 @@
  */
 
 #import "gpib_board.h"
+#import "gpib_profile.h"
 
 @interface gpib_link_arg : NSObject
 {
@@ -40,9 +41,9 @@
     BOOL bIsBoard;
     BOOL bTakeControl;
     board_info_ioctl_t boardInfo;
-    //read_write_ioctl_t readWrite;
+    read_write_ioctl_t readWrite;
     NSMutableDictionary * read_ioctl;
-    //wait_ioctl_t wait;
+    wait_ioctl_t wait;
     unsigned int nConfig;
     BOOL bSetIst;
     BOOL bClearIst;
@@ -67,6 +68,12 @@
      multiple ioctls. */
     pthread_mutex_t m_user_mutex;
     BOOL m_use_event_queue;
+    /* EOS configuration last applied to the board, every read sets it */
+    BOOL m_eos_valid;
+    int m_eos;
+    int m_eos_flags;
+    /* the board addresses devices itself, set when it comes online */
+    BOOL m_addressed_io;
 }
 //-(void) init_board_array:(unsigned int) length;
 -(int) serial_poll_all:(unsigned int) usec_timeout;
@@ -78,7 +85,7 @@
 -(int) ibonline;
 -(int) iboffline;
 -(int) iblines:(short *) lines;
--(int) ibrd : (UInt8 *) buf : (UInt32) length : (BOOL *) end_flag : (UInt32 *) nbytes_read;
+-(int) ibrd : (UInt8 *) buf : (UInt32) length : (gpib_descriptor *) address : (BOOL *) end_flag : (UInt32 *) nbytes_read;
 -(int) ibrpp:(uint8_t *) result;
 -(int) ibrsv:(unsigned int)  poll_status;
 -(void) ibrsc:(BOOL) request_control;
@@ -87,8 +94,11 @@
 -(int) ibpad: (unsigned int) addr;
 -(int) ibsad:(int) addr;
 -(int) ibeos:(int) eos : (int) eosflags;
+-(BOOL) addressed_io;
+-(private_board *) private_board;
 -(int) ibwait:(int) wait_mask : (int) clear_mask : (int) set_mask : (int *) status : (unsigned long) usec_timeout : (gpib_descriptor *) desc;
--(SInt32) ibwrt : (UInt8 *) buf : (UInt32) cnt : (BOOL) send_eoi : (UInt32 *) bytes_written;
+-(SInt32) ibwrt : (UInt8 *) buf : (UInt32) cnt : (gpib_descriptor *) address : (BOOL) send_eoi : (UInt32 *) bytes_written;
+-(SInt32) ibwrtv:(const struct iovec *) iov : (UInt32) iov_count : (gpib_descriptor *) address : (BOOL) send_eoi : (UInt32 *) bytes_written;
 -(int) ibstatus;
 -(int) general_ibstatus:(gpib_status_queue *) device : (int) clear_mask : (int) set_mask : (gpib_descriptor *) desc;
 -(int) ibppc:(unsigned int) configuration;
@@ -103,6 +113,7 @@
 -(int) read_serial_poll_byte:(unsigned int) pad : (int) sad :(unsigned int) usec_timeout : (uint8_t*) result;
 -(int) cleanup_serial_poll:(unsigned int) usec_timeout;
 -(int) serial_poll_single:(unsigned int) pad : (int) sad :(unsigned int) usec_timeout : (uint8_t *) result;
+-(int) serial_poll_list:(const UInt16 *) pads : (const SInt16 *) sads : (UInt32) num_devices : (BOOL) stop_on_rqs : (unsigned int) usec_timeout : (uint8_t *) results : (UInt32 *) num_polled;
 -(gpib_descriptor*) handle_to_descriptor:(int) handle;
 -(int) cleanup_open_devices;
 //-(void) init_gpib_sys:(gpib_board*) board;
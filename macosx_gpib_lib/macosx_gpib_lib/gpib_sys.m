@@ -72,7 +72,6 @@ static const unsigned int serial_timeout = 1000000;
     }
     
     retval = [self serial_poll_single:pad : sad : usec_timeout : result];
-    if( [m_board io_timed_out] ) retval = -ETIMEDOUT;
     
     return retval;
 }
@@ -102,7 +101,9 @@ static const unsigned int serial_timeout = 1000000;
         return 0;
     }
     
+    GPIB_PROFILE_START(start);
     retval = [m_board take_control:sync];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     if( retval < 0 )
         GPIB_DPRINTK("gpib: error while becoming active controller\n");
     
@@ -143,12 +144,16 @@ static const unsigned int serial_timeout = 1000000;
     ret = [self ibcac:0];
     if( ret == 0 )
     {
+        GPIB_PROFILE_START(start);
         ret = [m_board command:buf : length : bytes_written];
+        GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     }
     
     [m_board osRemoveTimer];
     
-    if([m_board io_timed_out])
+    if([m_board io_aborted])
+        ret = -EINTR;
+    else if([m_board io_timed_out])
         ret = -ETIMEDOUT;
     
     return ret;
@@ -164,14 +169,20 @@ static const unsigned int serial_timeout = 1000000;
  *          state prior to beginning the read.
  *      2.  Prior to calling ibrd, the intended devices as well
  *          as the interface board itself must be addressed by
- *          calling ibcmd.
+ *          calling ibcmd, unless 'address' is not nil in which case
+ *          the board addresses that device itself (see
+ *          supports_addressed_io).
+ *      3.  A read the board could not address because it is not
+ *          CIC fails with EPERM.
+ *      4.  A read cut short by abort_io fails with EINTR.
  */
 
--(int) ibrd : (UInt8 *) buf : (UInt32) length : (BOOL *) end_flag : (UInt32 *) nbytes_read
+-(int) ibrd : (UInt8 *) buf : (UInt32) length : (gpib_descriptor *) address : (BOOL *) end_flag : (UInt32 *) nbytes_read
 {
     int ret = 0;
     int retval;
     UInt32 bytes_read;
+    BOOL addressing = ( address != nil );
     
     *nbytes_read = 0;
     *end_flag = NO;
@@ -192,7 +203,14 @@ static const unsigned int serial_timeout = 1000000;
     [m_board osStartTimer];
     do
     {
-        ret = [m_board read:buf : length - *nbytes_read : end_flag : &bytes_read];
+        GPIB_PROFILE_START(start);
+        if( address != nil )
+            ret = [m_board addressed_read:buf : length - *nbytes_read : address->pad : address->sad : end_flag : &bytes_read];
+        else
+            ret = [m_board read:buf : length - *nbytes_read : end_flag : &bytes_read];
+        GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
+        /* the device stays addressed for the rest of the transfer */
+        address = nil;
         if(ret < 0)
         {
             //printk("gpib read error\n");
@@ -202,6 +220,10 @@ static const unsigned int serial_timeout = 1000000;
 
     }while(ret == 0 && *nbytes_read > 0 && *nbytes_read < length && *end_flag == 0);
     [m_board osRemoveTimer];
+    if( ret < 0 && [m_board io_aborted] )
+        ret = -EINTR;
+    else if( ret < 0 && addressing )
+        ret = [self addressing_error:ret];
     return ret;
 }
 
@@ -216,14 +238,34 @@ static const unsigned int serial_timeout = 1000000;
  *          placed in the controller standby state.
  *      2.  Prior to calling ibwrt, the intended devices as
  *          well as the interface board itself must be
- *          addressed by calling ibcmd.
+ *          addressed by calling ibcmd, unless 'address' is not
+ *          nil in which case the board addresses that device
+ *          itself (see supports_addressed_io).
+ *      3.  A write the board could not address because it is not
+ *          CIC fails with EPERM.
+ *      4.  A write cut short by abort_io fails with EINTR.
+ */
+-(SInt32) ibwrt : (UInt8 *) buf : (UInt32) cnt : (gpib_descriptor *) address : (BOOL) send_eoi : (UInt32 *) bytes_written
+{
+    struct iovec segment;
+    
+    segment.iov_base = buf;
+    segment.iov_len = cnt;
+    return [self ibwrtv:&segment : 1 : address : send_eoi : bytes_written];
+}
+
+/*
+ * IBWRTV
+ * Write the data gathered from iov_count segments as a single transfer,
+ * see gpib_board writev.
  */
--(SInt32) ibwrt : (UInt8 *) buf : (UInt32) cnt : (BOOL) send_eoi : (UInt32 *) bytes_written
+-(SInt32) ibwrtv:(const struct iovec *) iov : (UInt32) iov_count : (gpib_descriptor *) address : (BOOL) send_eoi : (UInt32 *) bytes_written
 {
     int ret = 0;
     int retval;
     
-    if( cnt == 0 )
+    *bytes_written = 0;
+    if( iov_count == 0 || ( iov_count == 1 && iov[0].iov_len == 0 ) )
     {
         GPIB_DPRINTK("gpib: ibwrt() called with zero length?\n");
         return 0;
@@ -235,16 +277,43 @@ static const unsigned int serial_timeout = 1000000;
         if( retval < 0 ) return retval;
     }
     [m_board osStartTimer];
-    ret = [m_board write:buf : cnt : send_eoi : bytes_written];
+    GPIB_PROFILE_START(start);
+    if( iov_count == 1 )
+    {
+        if( address != nil )
+            ret = [m_board addressed_write:iov[0].iov_base : (UInt32) iov[0].iov_len : address->pad : address->sad : send_eoi : bytes_written];
+        else
+            ret = [m_board write:iov[0].iov_base : (UInt32) iov[0].iov_len : send_eoi : bytes_written];
+    }else
+    {
+        if( address != nil )
+            ret = [m_board addressed_writev:iov : iov_count : address->pad : address->sad : send_eoi : bytes_written];
+        else
+            ret = [m_board writev:iov : iov_count : send_eoi : bytes_written];
+    }
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     
-    if([m_board io_timed_out])
+    if([m_board io_aborted])
+        ret = -EINTR;
+    else if([m_board io_timed_out])
         ret = -ETIMEDOUT;
+    else if( ret < 0 && address != nil )
+        ret = [self addressing_error:ret];
     
     [m_board osRemoveTimer];
     
     return ret;
 }
 
+/* a board addressing the device itself fails when it is not CIC, that
+ * is told apart from other errors only once the transfer failed */
+-(int) addressing_error:(int) ret
+{
+    if( ( [m_board update_status:0] & CIC ) == 0 )
+        return -EPERM;
+    return ret;
+}
+
 /*
  * IBGTS
  * Go to the controller standby state from the controller
@@ -258,10 +327,12 @@ static const unsigned int serial_timeout = 1000000;
     if( ( status & CIC ) == 0 )
     {
         GPIB_DPRINTK("gpib: not CIC during ibgts()\n" );
-        return -1;
+        return -EPERM;
     }
     
+    GPIB_PROFILE_START(start);
     retval = [m_board go_to_standby];                    /* go to standby */
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     if( retval < 0 )
         GPIB_DPRINTK("gpib: error while going to standby\n");
     
@@ -279,13 +350,18 @@ static const unsigned int serial_timeout = 1000000;
 {
     int status = 0;
     short line_status;
+    BOOL read_lines;
 
+    GPIB_PROFILE_START(start);
     status = [m_board update_status:clear_mask];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     /* XXX should probably stop having drivers use TIMO bit in
      * board->status to avoid confusion */
     status &= ~TIMO;
-    /* get real SRQI status if we can */
-    if([self iblines:&line_status] == 0)
+    /* get real SRQI status if we can.  A board raising SRQI from its
+     * interrupts only needs the lines to tell that SRQ was released */
+    read_lines = ([m_board interrupt_srq] == NO || (status & SRQI) || [m_board getStatusRefresh]);
+    if(read_lines && [self iblines:&line_status] == 0)
     {
         if((line_status & ValidSRQ))
         {
@@ -295,6 +371,7 @@ static const unsigned int serial_timeout = 1000000;
             }else
             {
                 status &= ~SRQI;
+                [gpib_board clear_bit:SRQI_NUM : &m_board->m_private_board.status];
             }
         }
     }
@@ -304,14 +381,15 @@ static const unsigned int serial_timeout = 1000000;
     
     if( desc )
     {
-        if(atomic_flag_test_and_set(&desc->io_in_progress))
+        /* CMPL is set when no I/O is in progress */
+        if( set_mask & CMPL )
+            atomic_store(&desc->io_in_progress, NO);
+        else if( clear_mask & CMPL )
+            atomic_store(&desc->io_in_progress, YES);
+        if(atomic_load(&desc->io_in_progress))
             status &= ~CMPL;
         else
             status |= CMPL;
-        if( set_mask & CMPL )
-            atomic_flag_test_and_set(&desc->io_in_progress);
-        else if( clear_mask & CMPL )
-            atomic_flag_clear(&desc->io_in_progress);
     }
     return status;
 }
@@ -324,12 +402,27 @@ static const unsigned int serial_timeout = 1000000;
  * Next LSB (bits 8-15) - STATUS lines mask (lines that are currently set).
  *
  */
+/* the board can address a device as part of a read or write, see
+ * supports_addressed_io.  Only valid while the board is online. */
+-(BOOL) addressed_io
+{
+    return m_addressed_io;
+}
+
+/* the board state the waits outside of the link thread look at */
+-(private_board *) private_board
+{
+    return &m_board->m_private_board;
+}
+
 -(int) iblines:(short *) lines
 {
     int retval;
     
     *lines = 0;
+    GPIB_PROFILE_START(start);
     retval = [m_board line_status];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     if(retval < 0) return retval;
     *lines = retval;
     return 0;
@@ -350,6 +443,8 @@ static const unsigned int serial_timeout = 1000000;
     }
 
     [m_board setOnline:YES];
+    m_eos_valid = NO;
+    m_addressed_io = [m_board supports_addressed_io];
     GPIB_DPRINTK( "gpib: board online\n" );
     
     return 0;
@@ -365,6 +460,8 @@ static const unsigned int serial_timeout = 1000000;
     [m_board detach];
     [m_board gpib_deallocate_board];
     [m_board setOnline:NO];
+    m_eos_valid = NO;
+    m_addressed_io = NO;
     GPIB_DPRINTK( "gpib: board offline\n" );
     
     return 0;
@@ -415,12 +512,15 @@ static const unsigned int serial_timeout = 1000000;
  * has a bit set for each condition which can terminate the wait
  * If the mask is 0 then
  * no condition is waited for.
+ * The link thread sleeps in its run loop between evaluations of the
+ * mask, it is woken up by the board's wait source.  When the wait
+ * times out the status is returned with TIMO set.
  */
 -(int) ibwait : (int) wait_mask : (int) clear_mask : (int) set_mask : (int *) status : (unsigned long) usec_timeout : (gpib_descriptor *) desc
 {
-    int retval = 0;
     gpib_status_queue *status_queue;
     struct wait_info winfo;
+    CFTimeInterval interval;
     
     if( desc->is_board ) status_queue = NULL;
     else status_queue = [m_board get_gpib_status_queue:desc->pad : desc->sad];
@@ -434,23 +534,24 @@ static const unsigned int serial_timeout = 1000000;
     [m_board init_wait_info: &winfo];
     winfo.usec_timeout = usec_timeout;
     [m_board startWaitTimer: &winfo];
-
-    while(winfo.timed_out==NO)
+    
+    if( wait_mask & ~wait_event_bits )
+        interval = wait_poll_interval;
+    else
+        interval = wait_forever;
+    
+    while([self wait_satisfied :&winfo : status_queue : wait_mask : status :desc ] == 0)
     {
-        CFRunLoopRunInMode(kCFRunLoopDefaultMode, 0, YES);
-        if([self wait_satisfied :&winfo : status_queue : wait_mask : status :desc ] == 1)
+        if(winfo.timed_out == YES)
+        {
+            GPIB_DPRINTK("wait timed out\n");
+            *status = [self general_ibstatus:status_queue : 0 : 0 : desc] | TIMO;
             break;
-    }
-
-    if(winfo.timed_out==YES)
-    {
-        GPIB_DPRINTK("wait interrupted\n");
-        retval = -ERESTARTSYS;
+        }
+        CFRunLoopRunInMode(kCFRunLoopDefaultMode, interval, YES);
     }
     [m_board removeWaitTimer: &winfo];
     
-    if(retval) return retval;
-    
     /* make sure we only clear status bits that we are reporting */
     if( *status & clear_mask || set_mask )
         [self general_ibstatus:status_queue : *status & clear_mask : set_mask : 0];
@@ -592,17 +693,26 @@ static const unsigned int serial_timeout = 1000000;
     {
         GPIB_DPRINTK("bad EOS modes\n" );
         return -EINVAL;
+    }
+    /* only the read EOS settings matter to the board */
+    if( eosflags & REOS )
+        eosflags &= REOS | BIN;
+    else
+        eos = eosflags = 0;
+    if( m_eos_valid && eos == m_eos && eosflags == m_eos_flags )
+        return 0;
+    
+    if( eosflags & REOS )
+    {
+        retval = [m_board enable_eos:eos : eosflags & BIN];
     }else
     {
-        if( eosflags & REOS )
-        {
-            retval = [m_board enable_eos:eos : eosflags & BIN];
-        }else
-        {
-            [m_board disable_eos];
-            retval = 0;
-        }
+        [m_board disable_eos];
+        retval = 0;
     }
+    m_eos_valid = retval >= 0;
+    m_eos = eos;
+    m_eos_flags = eosflags;
     return retval;
 }
 
@@ -629,8 +739,7 @@ static const unsigned int serial_timeout = 1000000;
     GPIB_DPRINTK( "autopoll_all_devices() complete\n" );
     /* need to wake wait queue in case someone is
      * waiting on RQS */
-    CFRunLoopSourceSignal(m_board->m_private_board.wait);
-    CFRunLoopWakeUp(m_board->m_private_board.runner);
+    gpib_wake_board(&m_board->m_private_board);
     pthread_mutex_unlock(&m_user_mutex);
     
     return retval;
@@ -658,7 +767,9 @@ static const unsigned int serial_timeout = 1000000;
     cmd_string[ i++ ] = SPE;	//serial poll enable
     
     [m_board osStartTimer:usec_timeout];
+    GPIB_PROFILE_START(start);
     ret = [m_board command:cmd_string : i : &bytes_written];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     if(ret < 0 || bytes_written < i )
     {
         GPIB_DPRINTK("gpib: failed to setup serial poll\n");
@@ -689,7 +800,9 @@ static const unsigned int serial_timeout = 1000000;
         cmd_string[i++] = MSA( sad );
     
     [m_board osStartTimer:usec_timeout];
+    GPIB_PROFILE_START(command_start);
     ret = [m_board command:cmd_string : i : &nbytes_read];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, command_start);
     if( ret < 0 || nbytes_read < i )
     {
         GPIB_DPRINTK("gpib: failed to setup serial poll\n");
@@ -700,7 +813,9 @@ static const unsigned int serial_timeout = 1000000;
     [self ibgts];
     
     // read poll result
+    GPIB_PROFILE_START(read_start);
     ret = [m_board read:result : 1 : &end_flag : &nbytes_read];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, read_start);
     if( ret < 0 || nbytes_read < 1)
     {
         GPIB_DPRINTK("gpib: serial poll failed\n" );
@@ -725,7 +840,9 @@ static const unsigned int serial_timeout = 1000000;
     cmd_string[ 0 ] = SPD;	/* disable serial poll bytes */
     cmd_string[ 1 ] = UNT;
     [m_board osStartTimer:usec_timeout];
+    GPIB_PROFILE_START(start);
     ret = [m_board command:cmd_string : 2 : &bytes_written];
+    GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
     if( ret < 0 || bytes_written < 2 )
     {
         GPIB_DPRINTK("gpib: failed to disable serial poll\n" );
@@ -739,17 +856,71 @@ static const unsigned int serial_timeout = 1000000;
 
 -(int) serial_poll_single : (unsigned int) pad : (int) sad :(unsigned int) usec_timeout : (uint8_t *) result
 {
-    int retval, cleanup_retval;
-    retval = [self setup_serial_poll:usec_timeout];
-    if( retval < 0 )
-        return retval;
-    retval = [self read_serial_poll_byte:pad : sad : usec_timeout : result];
-    cleanup_retval = [self cleanup_serial_poll: usec_timeout];
-    if( retval < 0 )
-        return retval;
-    if( cleanup_retval < 0 )
-        return cleanup_retval;
-    return 0;
+    UInt16 pads[1] = { pad };
+    SInt16 sads[1] = { sad };
+    UInt32 num_polled;
+    
+    return [self serial_poll_list:pads : sads : 1 : NO : usec_timeout : result : &num_polled];
+}
+
+/*
+ * Serial polls the 'num_devices' devices at 'pads'/'sads' in order, storing
+ * their status bytes in 'results'.  If 'stop_on_rqs' is set, polling stops
+ * after the first device requesting service.  'num_polled' returns the
+ * number of status bytes stored.  Boards able to conduct a serial poll by
+ * themselves poll each device in a single operation, otherwise SPE/SPD
+ * are sent once around the whole list.
+ */
+-(int) serial_poll_list : (const UInt16 *) pads : (const SInt16 *) sads : (UInt32) num_devices : (BOOL) stop_on_rqs : (unsigned int) usec_timeout : (uint8_t *) results : (UInt32 *) num_polled
+{
+    int retval = 0, cleanup_retval;
+    BOOL firmware_poll = [m_board supports_serial_poll];
+    
+    GPIB_DPRINTK( "entering serial_poll_list(), %i devices\n", num_devices );
+    
+    *num_polled = 0;
+    if( num_devices == 0 )
+        return 0;
+    
+    if( firmware_poll == NO )
+    {
+        retval = [self setup_serial_poll:usec_timeout];
+        if( retval < 0 ) return retval;
+    }
+    
+    for( UInt32 i = 0; i < num_devices; i++ )
+    {
+        if( pads[i] > gpib_addr_max || sads[i] > gpib_addr_max )
+        {
+            GPIB_DPRINTK("gpib: bad address for serial poll");
+            retval = -EINVAL;
+            break;
+        }
+        if( firmware_poll )
+        {
+            [m_board osStartTimer:usec_timeout];
+            GPIB_PROFILE_START(start);
+            retval = [m_board addressed_serial_poll:pads[i] : sads[i] : &results[i]];
+            GPIB_PROFILE_STOP(GPIB_PROFILE_BOARD, start);
+            if( [m_board io_timed_out] ) retval = -ETIMEDOUT;
+            [m_board osRemoveTimer];
+        }else
+        {
+            retval = [self read_serial_poll_byte:pads[i] : sads[i] : usec_timeout : &results[i]];
+            if( [m_board io_timed_out] ) retval = -ETIMEDOUT;
+        }
+        if( retval < 0 ) break;
+        (*num_polled)++;
+        if( stop_on_rqs && ( results[i] & request_service_bit ) ) break;
+    }
+    
+    if( firmware_poll == NO )
+    {
+        cleanup_retval = [self cleanup_serial_poll:usec_timeout];
+        if( retval == 0 ) retval = cleanup_retval;
+    }
+    
+    return retval;
 }
 
 -(int) serial_poll_all : (unsigned int) usec_timeout
@@ -757,35 +928,59 @@ static const unsigned int serial_timeout = 1000000;
     int retval = 0;
     gpib_descriptor *desc;
     gpib_status_queue* device;
-    uint8_t result;
+    UInt32 num_devices, next, num_polled;
+    UInt16 *pads;
+    SInt16 *sads;
+    uint8_t *results;
     unsigned int num_bytes = 0;
     
     GPIB_DPRINTK( "entering serial_poll_all()\n" );
     
-    if([m_descriptors count] == 0)
+    num_devices = (UInt32)[m_descriptors count];
+    if(num_devices == 0)
     {
         return 0;
     }
     
-    retval = [self setup_serial_poll:usec_timeout];
-    if( retval < 0 ) return retval;
-    
-    for(int index = 0; index < [m_descriptors count]; index ++)
+    pads = calloc(num_devices, sizeof(UInt16));
+    sads = calloc(num_devices, sizeof(SInt16));
+    results = calloc(num_devices, sizeof(uint8_t));
+    if( pads == NULL || sads == NULL || results == NULL )
+    {
+        free(pads);
+        free(sads);
+        free(results);
+        return -ENOMEM;
+    }
+    for(int index = 0; index < num_devices; index ++)
     {
         desc = (gpib_descriptor*)[m_descriptors objectAtIndex:index];
-        retval = [self read_serial_poll_byte:desc->pad : desc->sad : usec_timeout : &result];
-        if( retval < 0 ) continue;
-        if( result & request_service_bit )
+        pads[index] = desc->pad;
+        sads[index] = desc->sad;
+    }
+    
+    /* a device failing to answer is skipped, the others are still polled */
+    next = 0;
+    while( next < num_devices )
+    {
+        retval = [self serial_poll_list:pads + next : sads + next : num_devices - next : NO : usec_timeout :
+                  results + next : &num_polled];
+        for(UInt32 index = next; index < next + num_polled; index ++)
         {
-            device = [m_board get_gpib_status_queue:desc->pad : desc->sad];
-            retval = [m_board push_status_byte: device : result];
-            if( retval < 0 ) continue;
-            num_bytes++;
+            if( results[index] & request_service_bit )
+            {
+                device = [m_board get_gpib_status_queue:pads[index] : sads[index]];
+                if( [m_board push_status_byte: device : results[index]] < 0 ) continue;
+                num_bytes++;
+            }
         }
+        next += num_polled;
+        if( retval < 0 ) next++;
     }
     
-    retval = [self cleanup_serial_poll:usec_timeout];
-    if( retval < 0 ) return retval;
+    free(pads);
+    free(sads);
+    free(results);
     
     return num_bytes;
 }
@@ -849,7 +1044,9 @@ static const unsigned int serial_timeout = 1000000;
             retval = [m_board decrement_open_device_count:desc->pad : desc->sad];
             if( retval < 0 ) return retval;
         }
+        pthread_mutex_lock(&m_descriptors_mutex);
         [m_descriptors removeObject:desc];
+        pthread_mutex_unlock(&m_descriptors_mutex);
         //[desc release];
     }
     
@@ -861,7 +1058,7 @@ static const unsigned int serial_timeout = 1000000;
     desc->pad = 0;
     desc->sad = -1;
     desc->is_board = NO;
-    atomic_flag_clear(&desc->io_in_progress);
+    atomic_store(&desc->io_in_progress, NO);
 }
 
 -(BOOL) use_event_queue
@@ -263,7 +263,9 @@ enum ibask_option
 	IbaRsv = 0x21,	/* board only */
 	IbaBNA = 0x200,	/* device only */
 	/* linux-gpib extensions */
-	Iba7BitEOS = 0x1000	/* board only. Returns 1 if board supports 7 bit eos compares*/
+	Iba7BitEOS = 0x1000,	/* board only. Returns 1 if board supports 7 bit eos compares*/
+	/* macosx_gpib_lib extensions */
+	IbaStatusRefresh = 0x1100	/* board only. Returns 1 if ibsta is read from the hardware on every call */
 };
 
 enum ibconfig_option
@@ -299,7 +301,9 @@ enum ibconfig_option
 	IbcHSCableLength = 0x1f,	/* board only */
 	IbcIst = 0x20,	/* board only */
 	IbcRsv = 0x21,	/* board only */
-	IbcBNA = 0x200	/* device only */
+	IbcBNA = 0x200,	/* device only */
+	/* macosx_gpib_lib extensions */
+	IbcStatusRefresh = 0x1100	/* board only. Read ibsta from the hardware on every call instead of the driver's tracked state */
 };
 
 enum t1_delays
@@ -327,6 +331,11 @@ enum gpib_stb
 	IbStbMAV = 0x10  /* IEEE 488.2 only */
 };
 
+/* Completion callback of ibrda(), ibwrta() and ibcmda(), called from the
+ * asynchronous I/O thread with the final ibsta, iberr and ibcntl of the
+ * operation */
+typedef void (*gpib_aio_callback_t)( int ud, int ibsta, int iberr, long ibcntl, void *data );
+
 #endif	/* _GPIB_USER_H */
 
 /* Check for errors */
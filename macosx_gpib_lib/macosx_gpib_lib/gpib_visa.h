@@ -19,6 +19,7 @@
  */
 
 @class gpib_visa_internal;
+struct iovec;
 
 @interface gpib_visa : NSObject{
 @private
@@ -55,6 +56,7 @@
 -(void) TriggerList:(int) boardID : (uint16_t *) addressList;
 -(void) WaitSRQ:(int) boardID : (short *) result;
 -(const char*) ibname:(int) boardID;
+-(int) ibaionotify:(int) boardID : (void (*)(int, int, int, long, void *)) callback : (void *) data;
 -(int) ibask:(int) boardID : (int) option : (int *) value;
 -(int) ibbna:(int) boardID : (char *) board_name;
 -(int) ibcac:(int) boardID : (BOOL) synchronous;
@@ -79,7 +81,10 @@
 //-(int) ibrd:(int) boardID : (void *) buf : (long) count;
 -(int) ibrd:(int) boardID : (void *) buf : (long) count;
 -(int) ibrda:(int) boardID : (void *) buf : (long) count;
+-(int) ibrdblock:(int) boardID : (void *) buf : (long) count : (long *) block_length;
+-(int) ibrdblockalloc:(int) boardID : (void **) block : (long *) block_length;
 -(int) ibrdf:(int) boardID : (char *) file_path;
+-(int) ibrdtmo:(int) boardID : (void *) buf : (long) count : (unsigned int) usec_timeout;
 -(int) ibrpp:(int) boardID : (char *) ppr;
 -(int) ibrsc:(int) boardID : (BOOL) request_control;
 -(int) ibrsp:(int) boardID : (UInt8 *) spr;
@@ -93,9 +98,13 @@
 -(int) ibspb:(int) boardID : (short *) sp_bytes;
 -(const char*) ibvers;
 -(int) ibwait:(int) boardID : (int) mask;
+-(int) general_ibwait:(int) boardID : (int) mask : (BOOL) block;
+-(int) ibwaitany:(const int *) ud_list : (const int *) mask_list : (int) count : (int *) index;
 -(int) ibwrt:(int) boardID : (void *) buffer : (long) count;
 -(int) ibwrta:(int) boardID : (void *) buffer : (long) count;
 -(int) ibwrtf:(int) boardID : (char *) file_path;
+-(int) ibwrttmo:(int) boardID : (void *) buffer : (long) count : (unsigned int) usec_timeout;
+-(int) ibwrtv:(int) boardID : (const struct iovec *) iov : (int) count;
 -(int) ibclose:(int) boardID;
 -(int) ibopen:(int) boardID;
 -(void) close;
@@ -106,5 +115,6 @@
 -(int) ThreadIbsta;
 -(int) ThreadIberr;
 -(int) ThreadIbcnt;
+-(long) ThreadIbcntl;
 
 @end
@@ -56,10 +56,11 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
 
 -(void) AllSPoll:(int) boardID : (uint16_t *) addressList : (short *) resultList
 {
-    int i;
+    int i, num_addresses;
     ibConf_t *conf;
     gpib_link *board;
     int retval;
+    UInt8 *results;
     
     conf = [m_gpib_visa_internal enter_library:boardID];
     if( conf == NULL )
@@ -89,21 +90,22 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
         return;
     }
     
-    // XXX could use slightly more efficient ALLSPOLL protocol
-    retval = 0;
-    for( i = 0; i < [m_gpib_visa_internal numAddresses:addressList]; i++ )
+    num_addresses = [m_gpib_visa_internal numAddresses:addressList];
+    results = malloc( num_addresses );
+    if( results == NULL && num_addresses > 0 )
     {
-        UInt8 result;
-        retval = [m_gpib_visa_internal serial_poll:board : [m_gpib_visa_internal extractPAD:addressList[ i ]] :
-                  [m_gpib_visa_internal extractSAD:addressList[ i ]] : conf->settings.spoll_usec_timeout : &result];
-        if( retval < 0 )
-        {
-            if( errno == ETIMEDOUT )
-                conf->timed_out = 1;
-            break;
-        }
-        resultList[ i ] = result & 0xff;
+        [m_gpib_visa_internal setIberr:EDVR];
+        [m_gpib_visa_internal setIbcnt:ENOMEM];
+        [m_gpib_visa_internal exit_library:boardID : YES];
+        return;
     }
+    retval = [m_gpib_visa_internal serial_poll_list:board : addressList : NO : conf->settings.spoll_usec_timeout :
+              results : &i];
+    if( retval < 0 && errno == ETIMEDOUT )
+        conf->timed_out = 1;
+    for( int j = 0; j < i; j++ )
+        resultList[ j ] = results[ j ] & 0xff;
+    free( results );
     [m_gpib_visa_internal setIbcnt:i];
     
     if( retval < 0 )
@@ -344,10 +346,11 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
 
 -(void) FindRQS:(int) boardID : (uint16_t *) addressList : (short *) result
 {
-    int i;
+    int i, num_addresses;
     ibConf_t *conf;
     gpib_link *board;
     int retval;
+    UInt8 *results;
     
     conf = [m_gpib_visa_internal enter_library:boardID];
     if( conf == NULL )
@@ -377,26 +380,28 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
         return;
     }
     
-    retval = 0;
-    for( i = 0; i < [m_gpib_visa_internal numAddresses:addressList]; i++ )
+    num_addresses = [m_gpib_visa_internal numAddresses:addressList];
+    results = malloc( num_addresses );
+    if( results == NULL && num_addresses > 0 )
     {
-        UInt8 spoll_byte;
-        retval = [m_gpib_visa_internal serial_poll:board : [m_gpib_visa_internal extractPAD:addressList[i]] :
-                  [m_gpib_visa_internal extractSAD:addressList[i]] : conf->settings.usec_timeout : &spoll_byte];
-        if( retval < 0 )
-        {
-            if( errno == ETIMEDOUT )
-                conf->timed_out = 1;
-            break;
-        }
-        if( spoll_byte & request_service_bit )
-        {
-            *result = spoll_byte & 0xff;
-            break;
-        }
+        [m_gpib_visa_internal setIberr:EDVR];
+        [m_gpib_visa_internal setIbcnt:ENOMEM];
+        [m_gpib_visa_internal exit_library:boardID : YES];
+        return;
+    }
+    retval = [m_gpib_visa_internal serial_poll_list:board : addressList : YES : conf->settings.usec_timeout :
+              results : &i];
+    if( retval < 0 && errno == ETIMEDOUT )
+        conf->timed_out = 1;
+    // polling stops on the device requesting service
+    if( retval == 0 && i > 0 && ( results[ i - 1 ] & request_service_bit ) )
+    {
+        i--;
+        *result = results[ i ] & 0xff;
     }
+    free( results );
     [m_gpib_visa_internal setIbcnt:i];
-    if( i == [m_gpib_visa_internal numAddresses:addressList] )
+    if( i == num_addresses )
     {
         [m_gpib_visa_internal setIberr:ETAB];
         retval = -1;
@@ -1155,6 +1160,13 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
                 *value = !retval;
                 return [m_gpib_visa_internal exit_library:boardID: NO];
                 break;
+            case IbaStatusRefresh:
+                retval = [m_gpib_visa_internal query_status_refresh:board];
+                if( retval < 0 )
+                    return [m_gpib_visa_internal exit_library:boardID: YES];
+                *value = retval;
+                return [m_gpib_visa_internal exit_library:boardID: NO];
+                break;
             default:
                 break;
         }
@@ -1596,6 +1608,12 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
                 else
                     return [m_gpib_visa_internal exit_library:boardID : NO];
                 break;
+            case IbcStatusRefresh:
+                retval = [m_gpib_visa_internal set_status_refresh:[m_gpib_visa_internal interfaceBoard:conf] : value != 0];
+                if( retval < 0 )
+                    return [m_gpib_visa_internal exit_library:boardID : YES];
+                return [m_gpib_visa_internal exit_library:boardID : NO];
+                break;
             default:
                 break;
         }
@@ -1604,10 +1622,10 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
         switch( option )
         {
             case IbcREADDR:
-                /* We always re-address.  To support only
-                 * readdressing when necessary would require
-                 * making the driver keep track of current addressing
-                 * state.  Maybe someday, but low priority. */
+                /* When set, devices are addressed before every
+                 * read and write.  Otherwise the command phase is
+                 * skipped if the bus is still addressed for the
+                 * transfer, see device_io_setup. */
                 if( value )
                     conf->settings.readdr = 1;
                 else
@@ -1967,6 +1985,18 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
 }
 
 -(int) ibrd:(int) boardID : (void *) buf : (long) count
+{
+    return [self ibrdtmo:boardID : buf : count : NO : 0];
+}
+
+/* ibrd() bounded by a timeout of usec_timeout microseconds (0 waits
+ * forever) instead of the descriptor's, which is left untouched */
+-(int) ibrdtmo:(int) boardID : (void *) buf : (long) count : (unsigned int) usec_timeout
+{
+    return [self ibrdtmo:boardID : buf : count : YES : usec_timeout];
+}
+
+-(int) ibrdtmo:(int) boardID : (void *) buf : (long) count : (BOOL) explicit_timeout : (unsigned int) usec_timeout
 {
     ibConf_t *conf;
     ssize_t retval;
@@ -1976,7 +2006,10 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     if( conf == NULL )
         return [m_gpib_visa_internal exit_library:boardID : YES];
     
-    retval = [m_gpib_visa_internal my_ibrd:conf : buf : count : &bytes_read];
+    if( explicit_timeout == NO )
+        usec_timeout = conf->settings.usec_timeout;
+    
+    retval = [m_gpib_visa_internal my_ibrd:conf : buf : count : &bytes_read : usec_timeout];
 
     if(retval < 0)
     {
@@ -1991,6 +2024,46 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : DCAS : 0 : NO];
 }
 
+/* reads an IEEE 488.2 binary block ("#<n><length><payload>" or "#0")
+ * and stores its payload, without the header, in buf.  ibcnt is the
+ * payload stored and block_length the payload the header announced */
+-(int) ibrdblock:(int) boardID : (void *) buf : (long) count : (long *) block_length
+{
+    return [self ibrdblock:boardID : buf : count : NULL : block_length];
+}
+
+/* ibrdblock() into a buffer sized from the block header, returned in
+ * block and released by the caller with free() */
+-(int) ibrdblockalloc:(int) boardID : (void **) block : (long *) block_length
+{
+    return [self ibrdblock:boardID : NULL : 0 : (UInt8 **) block : block_length];
+}
+
+-(int) ibrdblock:(int) boardID : (void *) buf : (long) count : (UInt8 **) allocated : (long *) block_length
+{
+    ibConf_t *conf;
+    int retval;
+    size_t bytes_read, length;
+    
+    conf = [m_gpib_visa_internal enter_library:boardID];
+    if( conf == NULL )
+        return [m_gpib_visa_internal exit_library:boardID : YES];
+    
+    retval = [m_gpib_visa_internal read_block:conf : buf : count : allocated : &bytes_read : &length : conf->settings.usec_timeout];
+    if( block_length )
+        *block_length = length;
+    
+    if(retval < 0)
+    {
+        if([m_gpib_visa_internal ThreadIberr] != EDVR)
+            [m_gpib_visa_internal setIbcnt:bytes_read];
+        return [m_gpib_visa_internal exit_library:boardID : YES];
+    }
+    [m_gpib_visa_internal setIbcnt:bytes_read];
+    
+    return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : DCAS : 0 : NO];
+}
+
 -(int) ibrda:(int) boardID : (void *) buf : (long) count
 {
     ibConf_t *conf;
@@ -2007,12 +2080,25 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : 0 : 0 : YES];
 }
 
+/* 'callback' is called from the asynchronous I/O thread each time an
+ * ibrda(), ibwrta() or ibcmda() of 'boardID' completes, NULL disables */
+-(int) ibaionotify:(int) boardID : (void (*)(int, int, int, long, void *)) callback : (void *) data
+{
+    ibConf_t *conf;
+    
+    conf = [m_gpib_visa_internal general_enter_library:boardID : YES : YES];
+    if( conf == NULL )
+        return [m_gpib_visa_internal general_exit_library:boardID : YES : NO : NO : 0 : 0 : YES];
+    
+    [m_gpib_visa_internal internal_ibaionotify:conf : callback : data];
+    
+    return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : 0 : 0 : YES];
+}
+
 -(int) ibrdf:(int) boardID : (char *) file_path
 {
     ibConf_t *conf;
-    int retval;
-    UInt8 buffer[ 0x4000 ];
-    unsigned long byte_count;
+    size_t byte_count;
     FILE *save_file;
     BOOL error;
     
@@ -2031,8 +2117,9 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     if( conf->is_interface == 0 )
     {
         // set up addressing
-        if( [m_gpib_visa_internal InternalReceiveSetup:conf : [m_gpib_visa_internal packAddress: conf->settings.pad : conf->settings.sad]] < 0 )
+        if( [m_gpib_visa_internal device_io_setup:conf : YES] < 0 )
         {
+            fclose( save_file );
             return [m_gpib_visa_internal exit_library:boardID : YES];
         }
     }
@@ -2040,27 +2127,7 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     // set eos mode
     [m_gpib_visa_internal iblcleos:conf];
     
-    byte_count = error = 0;
-    do
-    {
-        int fwrite_count;
-        size_t bytes_read;
-        
-        retval = (int)[m_gpib_visa_internal read_data:conf : buffer : sizeof(buffer) : &bytes_read];
-        fwrite_count = (int)fwrite( buffer, 1, bytes_read, save_file );
-        if( fwrite_count != bytes_read )
-        {
-            [m_gpib_visa_internal setIberr:EFSO];
-            [m_gpib_visa_internal setIbcnt:errno];
-            error++;
-        }
-        byte_count += fwrite_count;
-        if( retval < 0 )
-        {
-            error++;
-            break;
-        }
-    }while( conf->end == 0 && error == 0 );
+    error = [m_gpib_visa_internal read_to_file:conf : save_file : &byte_count] < 0;
     
     [m_gpib_visa_internal setIbcnt:byte_count];
     
@@ -2227,7 +2294,8 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     if( retval < 0 )
         return [m_gpib_visa_internal general_exit_library:boardID : YES : NO : NO : 0 : 0 : YES];
     
-    return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : 0 : CMPL : YES];
+    /* ERR with EABO tells an operation was stopped */
+    return [m_gpib_visa_internal general_exit_library:boardID : retval > 0 : NO : NO : 0 : CMPL : YES];
 }
 
 -(int) ibtmo:(int) boardID : (int) timeout
@@ -2282,6 +2350,20 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
 }
 
 -(int) ibwait:(int) boardID : (int) mask
+{
+    int index;
+    
+    /* the asynchronous worker needs the board link to finish its
+     * transfer, so while any descriptor on the board has one in flight
+     * the wait runs on the calling thread */
+    if( [m_gpib_visa_internal gpib_aio_board_busy:boardID] )
+        return [self ibwaitany:&boardID : &mask : 1 : &index];
+    return [self general_ibwait:boardID : mask : YES];
+}
+
+/* with 'block' set to NO the status is only checked, the bits of 'mask'
+ * that ibwait clears are cleared only if they are reported */
+-(int) general_ibwait:(int) boardID : (int) mask : (BOOL) block
 {
     ibConf_t *conf;
     int retval;
@@ -2294,7 +2376,14 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
         return [m_gpib_visa_internal general_exit_library:boardID : YES : NO : NO : 0 : 0 : YES];
     
     clear_mask = mask & ( DTAS | DCAS | SPOLL);
-    retval = [m_gpib_visa_internal my_wait:conf : mask : clear_mask : 0 : &status];
+    if( block )
+        retval = [m_gpib_visa_internal my_wait:conf : mask : clear_mask : 0 : &status];
+    else
+    {
+        retval = [m_gpib_visa_internal my_wait:conf : 0 : 0 : 0 : &status];
+        if( retval == 0 && ( status & mask ) && ( status & clear_mask ) )
+            retval = [m_gpib_visa_internal my_wait:conf : 0 : status & clear_mask : 0 : &status];
+    }
     if( retval < 0 )
         return [m_gpib_visa_internal general_exit_library:boardID : YES : NO : NO : 0 : 0 : YES];
     
@@ -2325,7 +2414,140 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     return status;
 }
 
+/*
+ * Waits until one of the 'count' descriptors of 'ud_list' satisfies its
+ * mask in 'mask_list' and returns its status, 'index' is set to its
+ * position in the list.  The timeout is the shortest one of the
+ * descriptors with TIMO in their mask, without any the wait is endless.
+ * On timeout only TIMO is returned and 'index' is set to -1.
+ * Runs on the calling thread.  A descriptor is looked at again only when
+ * its board signals an event, or every wait_poll_interval when its mask
+ * has bits that signal none.  Looking at it takes a request to its board
+ * link, one the link thread cannot start before the timeout is given up.
+ */
+-(int) ibwaitany:(const int *) ud_list : (const int *) mask_list : (int) count : (int *) index
+{
+    ibConf_t *conf;
+    private_board **boards;
+    UInt64 *events, current;
+    BOOL *checked;
+    int status = 0;
+    int i;
+    unsigned int usec_timeout = 0;
+    BOOL poll = NO, poll_due, done = NO;
+    CFAbsoluteTime deadline = 0, next_poll = 0, now;
+    CFTimeInterval interval;
+    
+    *index = -1;
+    if( count <= 0 )
+    {
+        [m_gpib_visa_internal setIberr:EARG];
+        [m_gpib_visa_internal setIbsta:ERR];
+        return ERR;
+    }
+    boards = malloc( count * sizeof( *boards ) );
+    events = malloc( count * sizeof( *events ) );
+    checked = calloc( count, sizeof( *checked ) );
+    if( boards == NULL || events == NULL || checked == NULL )
+    {
+        free( boards );
+        free( events );
+        free( checked );
+        [m_gpib_visa_internal setIberr:EDVR];
+        [m_gpib_visa_internal setIbcnt:ENOMEM];
+        [m_gpib_visa_internal setIbsta:ERR];
+        return ERR;
+    }
+    for( i = 0; i < count; i++ )
+    {
+        conf = [m_gpib_visa_internal general_enter_library:ud_list[ i ] : YES : NO];
+        if( conf == NULL )
+        {
+            free( boards );
+            free( events );
+            free( checked );
+            return [m_gpib_visa_internal general_exit_library:ud_list[ i ] : YES : NO : NO : 0 : 0 : YES];
+        }
+        boards[ i ] = [[m_gpib_visa_internal interfaceBoard:conf] private_board];
+        if( ( mask_list[ i ] & TIMO ) && conf->settings.usec_timeout &&
+           ( usec_timeout == 0 || conf->settings.usec_timeout < usec_timeout ) )
+            usec_timeout = conf->settings.usec_timeout;
+        if( mask_list[ i ] & ~wait_event_bits )
+            poll = YES;
+        [m_gpib_visa_internal general_exit_library:ud_list[ i ] : NO : YES : YES : 0 : 0 : YES];
+    }
+    if( usec_timeout )
+        deadline = CFAbsoluteTimeGetCurrent() + usec_timeout / 1.0e6;
+    [gpib_link set_submit_deadline:deadline];
+    
+    while( done == NO )
+    {
+        now = CFAbsoluteTimeGetCurrent();
+        poll_due = poll && now >= next_poll;
+        if( poll_due )
+            next_poll = now + wait_poll_interval;
+        for( i = 0; i < count; i++ )
+        {
+            /* take the count before looking, so no event gets lost */
+            current = gpib_event_count( boards[ i ] );
+            if( checked[ i ] && current == events[ i ] &&
+               ( poll_due == NO || ( mask_list[ i ] & ~wait_event_bits ) == 0 ) )
+                continue;
+            events[ i ] = current;
+            checked[ i ] = YES;
+            status = [self general_ibwait:ud_list[ i ] : mask_list[ i ] & ~TIMO : NO];
+            if( status & mask_list[ i ] & ~TIMO )
+                *index = i;
+            /* a request the link could not start in time fails as well */
+            if( ( status & ERR ) && *index < 0 && usec_timeout && CFAbsoluteTimeGetCurrent() >= deadline )
+                break;
+            if( ( status & ERR ) || *index >= 0 )
+            {
+                done = YES;
+                break;
+            }
+        }
+        if( done )
+            break;
+        now = CFAbsoluteTimeGetCurrent();
+        interval = poll ? next_poll - now : wait_forever;
+        if( usec_timeout )
+        {
+            if( deadline - now <= 0 )
+            {
+                *index = -1;
+                status = TIMO;
+                [m_gpib_visa_internal setIberr:0];
+                [m_gpib_visa_internal setIbcnt:0];
+                [m_gpib_visa_internal setIbsta:status];
+                break;
+            }
+            if( deadline - now < interval )
+                interval = deadline - now;
+        }
+        if( interval > 0 )
+            gpib_wait_event( boards, events, count, interval );
+    }
+    [gpib_link set_submit_deadline:0];
+    
+    free( boards );
+    free( events );
+    free( checked );
+    return status;
+}
+
 -(int) ibwrt:(int) boardID : (void *) buffer : (long) count
+{
+    return [self ibwrttmo:boardID : buffer : count : NO : 0];
+}
+
+/* ibwrt() bounded by a timeout of usec_timeout microseconds, see ibrdtmo */
+-(int) ibwrttmo:(int) boardID : (void *) buffer : (long) count : (unsigned int) usec_timeout
+{
+    return [self ibwrttmo:boardID : buffer : count : YES : usec_timeout];
+}
+
+-(int) ibwrttmo:(int) boardID : (void *) buffer : (long) count : (BOOL) explicit_timeout : (unsigned int) usec_timeout
 {
     ibConf_t *conf;
     size_t scount;
@@ -2336,8 +2558,10 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
         return [m_gpib_visa_internal exit_library:boardID : YES];
     
     conf->end = 0;
+    if( explicit_timeout == NO )
+        usec_timeout = conf->settings.usec_timeout;
     
-    retval = [m_gpib_visa_internal my_ibwrt:conf : buffer : count : &scount];
+    retval = [m_gpib_visa_internal my_ibwrt:conf : buffer : count : &scount : usec_timeout];
     if(retval < 0)
     {
         if([m_gpib_visa_internal ThreadIberr] != EDVR)
@@ -2348,6 +2572,38 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
     return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : DCAS : 0 : NO];
 }
 
+/* writes the data gathered from 'count' segments as a single message,
+ * saving the caller from concatenating a header, a payload and a
+ * terminator.  EOI and EOS handling only apply at the end of the data */
+-(int) ibwrtv:(int) boardID : (const struct iovec *) iov : (int) count
+{
+    ibConf_t *conf;
+    size_t scount;
+    int retval;
+    
+    conf = [m_gpib_visa_internal enter_library:boardID];
+    if( conf == NULL )
+        return [m_gpib_visa_internal exit_library:boardID : YES];
+    
+    if( count < 0 || ( count > 0 && iov == NULL ) )
+    {
+        [m_gpib_visa_internal setIberr:EARG];
+        return [m_gpib_visa_internal exit_library:boardID : YES];
+    }
+    
+    conf->end = 0;
+    
+    retval = [m_gpib_visa_internal my_ibwrtv:conf : iov : count : &scount : conf->settings.usec_timeout];
+    if(retval < 0)
+    {
+        if([m_gpib_visa_internal ThreadIberr] != EDVR)
+            [m_gpib_visa_internal setIbcnt:scount];
+        return [m_gpib_visa_internal exit_library:boardID : YES];
+    }
+    [m_gpib_visa_internal setIbcnt:scount];
+    return [m_gpib_visa_internal general_exit_library:boardID : NO : NO : NO : DCAS : 0 : NO];
+}
+
 -(int) ibwrta:(int) boardID : (void *) buffer : (long) count
 {
     ibConf_t *conf;
@@ -2444,6 +2700,10 @@ const char GPIB_SCM_VERSION[6] = "1.0.3a";
 {
     return [m_gpib_visa_internal ThreadIbcnt];
 }
+-(long) ThreadIbcntl
+{
+    return [m_gpib_visa_internal ThreadIbcntl];
+}
 
 
 @end
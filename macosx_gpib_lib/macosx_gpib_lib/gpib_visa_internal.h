@@ -23,6 +23,10 @@
 
 #define GPIB_CONFIGS_LENGTH 0x1000
 #define FIND_CONFIGS_LENGTH 64	/* max number of devices we can read from config file */
+#define GPIB_STREAM_CHUNK 0x100000	/* file buffer of ibrdf/ibwrtf, the link splits it in board transfers */
+#define GPIB_STREAM_BUFFERS 4	/* ibrdf buffers, the bus fills one while the others are written to disk */
+#define GPIB_BLOCK_CHUNK 0x10000	/* first buffer allocated for an indefinite length block, doubled as needed */
+#define GPIB_BLOCK_TERMINATOR_USEC_TIMEOUT 100000	/* wait for the byte following a definite length block */
 
 static const uint16_t NOADDR = (uint16_t)-1;
 
@@ -30,6 +34,8 @@ static const uint16_t NOADDR = (uint16_t)-1;
 /* tells RcvRespMsg() to stop on EOI */
 static const int STOPend = 0x100;
 static const int default_ppoll_usec_timeout = 2;
+/* how often ibstop repeats the abort until the operation completes */
+static const NSTimeInterval aio_abort_interval = 0.01;
 static const int sad_offset = 0x60;
 
 @interface gpib_aio_arg : NSObject
@@ -104,15 +110,19 @@ static const char* error_descriptions[] =
     ibConf_t *ibFindConfigs[ FIND_CONFIGS_LENGTH ];
     //gpib_link * m_ibBoard[ GPIB_MAX_NUM_BOARDS ];
     NSMutableArray *board_list;
-    NSMutableDictionary *thread_key;
     NSMutableArray *ibConfigs_list;
+    NSMutableDictionary *aio_workers;	/* asynchronous I/O thread of each board */
+    pthread_mutex_t aio_workers_lock;
+    atomic_int aio_pending[GPIB_MAX_NUM_BOARDS + 1];	/* asynchronous operations not completed on each board */
 }
 
 +(uint16_t) MakeAddr:(UInt8) pad : (UInt8) sad;
 +(UInt8) GetPAD:(uint16_t) address;
 +(UInt8) GetSAD:(uint16_t) address;
++(void) set_board_class:(Class) classBoard;
++(Class) board_class;
 
--(void) globals_alloc;
+-(NSMutableDictionary *) globals_alloc;
 -(int) findBoardWithName:(const char *) name;
 -(void) init_descriptor_settings:(descriptor_settings_t *) settings;
 -(int) insert_descriptor:(ibConf_t*) conf : (int) ud;
@@ -126,8 +136,11 @@ static const char* error_descriptions[] =
 -(int) ibGetDescriptor:(ibConf_t*) conf;
 -(int) ibFindDevIndex:(char *) name;
 -(ssize_t) my_ibcmd:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) length;
--(ssize_t) my_ibrd:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read;
--(int) my_ibwrt:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_written;
+-(ssize_t) my_ibrd:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read : (UInt32) usec_timeout;
+-(int) my_ibwrt:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_written : (UInt32) usec_timeout;
+-(int) my_ibwrtv:(ibConf_t *) conf : (const struct iovec *) iov : (UInt32) iov_count : (size_t *) bytes_written : (UInt32) usec_timeout;
+-(int) read_to_file:(ibConf_t *) conf : (FILE *) save_file : (size_t *) bytes_read;
+-(int) read_block:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (UInt8 **) allocated : (size_t *) bytes_read : (size_t *) block_length : (UInt32) usec_timeout;
 -(UInt8) send_setup_string:(ibConf_t *) conf : (UInt8 *) cmdString;
 -(UInt8) create_send_setup:(gpib_link *) board : (uint16_t *) addressList : (UInt8 *) cmdString;
 -(int) send_setup:(ibConf_t *) conf;
@@ -157,6 +170,10 @@ static const char* error_descriptions[] =
 -(int) query_board_t1_delay:(gpib_link *) board;
 -(int) query_board_rsv:(gpib_link *) board;
 -(int) query_no_7_bit_eos:(gpib_link *) board;
+-(int) query_status_refresh:(gpib_link *) board;
+-(int) set_status_refresh:(gpib_link *) board : (BOOL) enable;
+-(int) addressed_io_setup:(ibConf_t *) conf;
+-(int) device_io_setup:(ibConf_t *) conf : (BOOL) device_talks;
 -(int) conf_online:(ibConf_t *) conf : (BOOL) online;
 -(int) configure_autospoll:(ibConf_t *) conf : (BOOL) enable;
 -(int) extractPAD:(uint16_t) address;
@@ -200,6 +217,10 @@ static const char* error_descriptions[] =
 -(int) ibCheckDescriptor:(int) ud;
 -(int) board_online:(int) boardId : (BOOL) online;
 -(int) gpib_aio_launch:(int) ud : (ibConf_t *) conf : (int) gpib_aio_type : (void *) buffer : (long) cnt;
+-(NSThread *) gpib_aio_worker:(ibConf_t *) conf;
+-(BOOL) gpib_aio_join:(ibConf_t *) conf : (NSTimeInterval) timeout;
+-(BOOL) gpib_aio_board_busy:(int) ud;
+-(int) internal_ibaionotify:(ibConf_t *) conf : (gpib_aio_callback_t) callback : (void *) data;
 -(int) set_spoll_timeout:(ibConf_t *) conf : (int) timeout;
 -(int) set_ppoll_timeout:(ibConf_t *)conf : (int) timeout;
 -(int) set_t1_delay:(gpib_link *)board : (int) delay;
@@ -210,13 +231,16 @@ static const char* error_descriptions[] =
 -(int) device_ppc:(ibConf_t *) conf : (int) ppc_configuration;
 -(int) board_ppc:(ibConf_t *) conf : (int) ppc_configuration;
 -(int) ppoll_configure_device:(ibConf_t *) conf : (uint16_t *) addressList : (int) ppc_configuration;
--(ssize_t) read_data:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read;
+-(ssize_t) read_data:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read : (UInt32) usec_timeout;
 -(int) serial_poll:(gpib_link *) board : (UInt8) pad : (SInt8) sad : (UInt32) usec_timeout : (UInt8 *) result;
+-(int) serial_poll_list:(gpib_link *) board : (uint16_t *) addressList : (BOOL) stop_on_rqs : (UInt32) usec_timeout : (UInt8 *) results : (int *) num_polled;
 -(void) fixup_status_bits:(ibConf_t *)conf : (int *) status;
--(int) send_data:(ibConf_t *)conf : (void *) buffer : (size_t) count : (BOOL) send_eoi : (size_t *) bytes_written;
+-(int) send_data:(ibConf_t *)conf : (void *) buffer : (size_t) count : (BOOL) send_eoi : (size_t *) bytes_written : (UInt32) usec_timeout;
+-(int) send_datav:(ibConf_t *)conf : (const struct iovec *) iov : (UInt32) iov_count : (BOOL) send_eoi : (size_t *) bytes_written : (UInt32) usec_timeout;
 -(int) my_ibwrtf:(ibConf_t *) conf : (char *) file_path : (size_t *) bytes_written;
--(int) send_data_smart_eoi:(ibConf_t *) conf : (void *) buffer : (size_t) count : (int) force_eoi : (size_t *) bytes_written;
--(int) find_eos:(UInt8 *) buffer : (size_t) length : (int) eos : (int) eos_flags;
+-(int) send_data_smart_eoi:(ibConf_t *) conf : (void *) buffer : (size_t) count : (int) force_eoi : (size_t *) bytes_written : (UInt32) usec_timeout;
+-(int) send_datav_smart_eoi:(ibConf_t *) conf : (struct iovec *) iov : (UInt32) iov_count : (int) force_eoi : (size_t *) bytes_written : (UInt32) usec_timeout;
+-(ssize_t) find_eos:(UInt8 *) buffer : (size_t) length : (int) eos : (int) eos_flags;
 -(int) local_lockout:(ibConf_t *) conf : (uint16_t *) addressList;
 -(void) do_aio:(gpib_aio_arg *)arg;
 -(int) my_ibdev:(ibConf_t*) new_conf;
@@ -229,5 +253,6 @@ static const char* error_descriptions[] =
 -(int) ThreadIbsta;
 -(int) ThreadIberr;
 -(int) ThreadIbcnt;
+-(long) ThreadIbcntl;
 
 @end
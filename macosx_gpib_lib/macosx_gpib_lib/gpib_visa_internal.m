@@ -20,9 +20,13 @@
 
 //#import <Foundation/Foundation.h>
 #import "sys/stat.h"
+#import <sys/mman.h>
 #import "gpib_visa_internal.h"
 #import "Agilent_82357_AB.h"
+#import "gpib_eos.h"
 
+/* board driver used by the next gpib_visa_internal, nil for the default */
+static Class default_board_class = nil;
 
 @implementation gpib_aio_arg
 @end
@@ -33,15 +37,48 @@
 
 @implementation gpib_visa_internal
 
++(void) set_board_class:(Class) classBoard
+{
+    default_board_class = classBoard;
+}
+
+/* The board driver is agilent_82357_ab unless another gpib_board subclass
+ * has been set with set_board_class: or is named by the GPIB_BOARD_CLASS
+ * environment variable (e.g. gpib_sim_board) */
++(Class) board_class
+{
+    const char *name;
+    Class classBoard;
+    
+    if(default_board_class != nil)
+        return default_board_class;
+    name = getenv("GPIB_BOARD_CLASS");
+    if(name == NULL || *name == '\0')
+        return [agilent_82357_ab class];
+    classBoard = NSClassFromString([NSString stringWithUTF8String:name]);
+    if(classBoard == nil || [classBoard isSubclassOfClass:[gpib_board class]] == NO)
+    {
+        fprintf(stderr, "libmacosx_gpib: unknown board class %s, using agilent_82357_ab\n", name);
+        return [agilent_82357_ab class];
+    }
+    return classBoard;
+}
+
 -(id) init
 {
     self = [super init];
     board_list = [[NSMutableArray alloc] init];
+    aio_workers = [[NSMutableDictionary alloc] init];
+    pthread_mutex_init( &aio_workers_lock, NULL );
     gpib_link* board;
     int boardId = 0;
+    int i;
+    for( i = 0; i <= GPIB_MAX_NUM_BOARDS; i++ )
+        atomic_init( &aio_pending[ i ], 0 );
+    Class classBoard = [gpib_visa_internal board_class];
     while([board_list count]<GPIB_MAX_NUM_BOARDS+1)
     {
-        board = [[gpib_link alloc] init_gpib_link:[agilent_82357_ab class]];
+        board = [[gpib_link alloc] init_gpib_link:classBoard];
         [board_list addObject:board];
         boardId = (int)[board_list indexOfObject:board];
         if([self configure_board:boardId : 0 :-1 :YES :YES :YES])
@@ -235,7 +272,7 @@
     pthread_mutex_init( &async->lock, NULL );
     pthread_mutex_init( &async->join_lock, NULL );
     //pthread_cond_init(&async->condition, NULL);
-    async->condition = nil;
+    async->condition = [[NSCondition alloc] init];
     async->buffer = nil;
     async->buffer_length = 0;
     async->iberr = 0;
@@ -244,6 +281,8 @@
     async->in_progress = NO;
     async->abort = 0;
     async->thread = nil;
+    async->callback = NULL;
+    async->callback_data = NULL;
 }
 
 -(int) ibGetDescriptor:(ibConf_t*) conf
@@ -319,12 +358,10 @@
     settings->readdr = 0;
 }
 
--(void) globals_alloc
+/* ibsta, iberr and ibcntl of the calling thread */
+-(NSMutableDictionary *) globals_alloc
 {
-    if (thread_key ==nil)
-    {
-        thread_key = [[[NSThread currentThread] threadDictionary] init];
-    }
+    NSMutableDictionary *thread_key = [[NSThread currentThread] threadDictionary];
     if ([thread_key objectForKey:@"ibsta_key"] == nil)
     {
         NSNumber *ibsta_key = [[NSNumber alloc] initWithInt:0];
@@ -340,24 +377,22 @@
         NSNumber *ibcntl_key = [[NSNumber alloc] initWithInt:0];
         [thread_key setObject:ibcntl_key forKey:@"ibcntl_key"];
     }
+    return thread_key;
 }
 
 -(void) setIberr:(int) error
 {
-    [self globals_alloc];
-    [thread_key setValue:[NSNumber numberWithInt:error] forKey:@"iberr_key"];
+    [[self globals_alloc] setValue:[NSNumber numberWithInt:error] forKey:@"iberr_key"];
 }
 
 -(void) setIbcnt:(long) count
 {
-    [self globals_alloc];
-    [thread_key setValue:[NSNumber numberWithLong:count] forKey:@"ibcntl_key"];
+    [[self globals_alloc] setValue:[NSNumber numberWithLong:count] forKey:@"ibcntl_key"];
 }
 
 -(void) setIbsta:(int) status
 {
-    [self globals_alloc];
-    [thread_key setValue:[NSNumber numberWithInt:status] forKey:@"ibsta_key"];
+    [[self globals_alloc] setValue:[NSNumber numberWithInt:status] forKey:@"ibsta_key"];
 }
 
 -(unsigned int) timeout_to_usec:(enum gpib_timeout) timeout
@@ -541,37 +576,28 @@
 {
     int retval;
     gpib_link *board;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
+    read_write_ioctl_t cmd;
     
     board = [self interfaceBoard:conf];
     
-    [self set_timeout:board : conf->settings.usec_timeout];
-    
     if( [self is_cic:board] == NO )
     {
         [self setIberr:ECIC];
         return -1;
     }
     
-    //assert(sizeof(buffer) <= sizeof(arg->readWrite.buffer_ptr));
-    /*arg->readWrite.buffer_ptr = buffer;
-    arg->readWrite.requested_transfer_count = count;
-    arg->readWrite.completed_transfer_count = 0;
-    arg->readWrite.handle = conf->handle;
-    arg->readWrite.end = 0;
-    arg->nUsecDuration = conf->settings.usec_timeout;*/
-    arg->cmd = IBCMD;
-    arg->read_ioctl = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
-                       [NSNumber numberWithInteger:conf->handle],@"handle",
-                       [[NSMutableData alloc] initWithBytes:buffer length:count],@"buffer",
-                       [NSNumber numberWithInteger:count],@"requested_transfer_count",
-                       [NSNumber numberWithInteger:0],@"completed_transfer_count",
-                       [NSNumber numberWithBool:NO],@"end",
-                       nil];
-    
-    [self set_timeout:board : conf->settings.usec_timeout];
+    cmd.buffer_ptr = buffer;
+    cmd.requested_transfer_count = count;
+    cmd.completed_transfer_count = 0;
+    cmd.handle = conf->handle;
+    cmd.end = NO;
+    /* the link records the addressing device_io_setup sends */
+    cmd.address = conf->setup_pending;
+    cmd.device_talks = conf->setup_device_talks;
+    conf->setup_pending = NO;
+    cmd.usec_timeout = conf->settings.usec_timeout;
     
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBCMD : &cmd];
     
     if( retval < 0 )
     {
@@ -581,6 +607,9 @@
                 [self setIberr:EBUS];
                 conf->timed_out = YES;
                 break;
+            case EINTR:
+                [self setIberr:EABO];
+                break;
             default:
                 [self setIberr:EDVR];
                 [self setIbcnt:errno];
@@ -589,8 +618,7 @@
         return -1;
     }
     
-    //return arg->readWrite.completed_transfer_count;
-    return [[arg->read_ioctl valueForKey:@"completed_transfer_count"] intValue];
+    return cmd.completed_transfer_count;
 }
 
 -(UInt8) create_send_setup:(gpib_link *) board : (uint16_t *) addressList : (UInt8 *) cmdString
@@ -714,13 +742,9 @@
 -(int) query_ist:(gpib_link *) board
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    
-    arg->cmd = IBBOARD_INFO;
+    board_info_ioctl_t info;
     
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
     if( retval < 0 )
     {
         [self setIberr:EDVR];
@@ -728,17 +752,15 @@
         return retval;
     }
     
-    return arg->boardInfo.ist;
+    return info.ist;
 }
 
 -(int) query_ppc:(gpib_link *) board
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    board_info_ioctl_t info;
+    
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
     if( retval < 0 )
     {
         [self setIberr:EDVR];
@@ -746,18 +768,15 @@
         return retval;
     }
     
-    return arg->boardInfo.parallel_poll_configuration;
+    return info.parallel_poll_configuration;
 }
 
 -(int) query_autopoll:(gpib_link *) board
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
+    board_info_ioctl_t info;
     
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
     if( retval < 0 )
     {
         [self setIberr:EDVR];
@@ -765,18 +784,15 @@
         return retval;
     }
     
-    return arg->boardInfo.autopolling;
+    return info.autopolling;
 }
 
 -(int) query_board_t1_delay:(gpib_link *) board
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
+    board_info_ioctl_t info;
     
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
     if( retval < 0 )
     {
         [self setIberr:EDVR];
@@ -784,13 +800,13 @@
         return retval;
     }
     
-    if(arg->boardInfo.t1_delay == 0)
+    if(info.t1_delay == 0)
     {
         fprintf(stderr, "%s: bug! we don't know what the T1 delay is because it has never been set.\n",
                 __FUNCTION__);
         return -EIO;
-    }else if( arg->boardInfo.t1_delay < 500 ) return T1_DELAY_350ns;
-    else if( arg->boardInfo.t1_delay < 2000 ) return T1_DELAY_500ns;
+    }else if( info.t1_delay < 500 ) return T1_DELAY_350ns;
+    else if( info.t1_delay < 2000 ) return T1_DELAY_500ns;
     return T1_DELAY_2000ns;
 }
 
@@ -816,11 +832,9 @@
 -(int) query_pad:(gpib_link *) board : (UInt8 *) pad;
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    board_info_ioctl_t info;
+    
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
 
     if( retval < 0 )
     {
@@ -829,18 +843,16 @@
         return retval;
     }
     
-    *pad = arg->boardInfo.pad;
+    *pad = info.pad;
     return 0;
 }
 
 -(int) query_sad:(gpib_link *) board : (int *) sad;
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    board_info_ioctl_t info;
+    
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
 
     if( retval < 0 )
     {
@@ -849,17 +861,48 @@
         return retval;
     }
     
-    *sad = arg->boardInfo.sad;
+    *sad = info.sad;
     return 0;
 }
 
 -(int) query_no_7_bit_eos:(gpib_link *) board
 {
     int retval;
-    //board_info_ioctl_t info;
+    board_info_ioctl_t info;
+    
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
+
+    if( retval < 0 )
+    {
+        [self setIberr:EDVR];
+        [self setIbcnt:errno];
+        return retval;
+    }
+    return info.no_7_bit_eos;
+}
+
+-(int) query_status_refresh:(gpib_link *) board
+{
+    int retval;
+    board_info_ioctl_t info;
+    
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
+
+    if( retval < 0 )
+    {
+        [self setIberr:EDVR];
+        [self setIbcnt:errno];
+        return retval;
+    }
+    return info.status_refresh;
+}
+
+-(int) set_status_refresh:(gpib_link *) board : (BOOL) enable
+{
+    int retval;
     gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
-    //retval = ioctl(board->fileno, IBBOARD_INFO, &info);
+    arg->cmd = IBSTATUS_REFRESH;
+    arg->bEnable = enable;
     retval = [board ioctl:arg];
 
     if( retval < 0 )
@@ -868,7 +911,55 @@
         [self setIbcnt:errno];
         return retval;
     }
-    return arg->boardInfo.no_7_bit_eos;
+    return 0;
+}
+
+/* Lets the board address the device as part of the next read or write,
+ * saving the separate UNL/MLA/MTA command transfer.  Returns 1 if the
+ * board will do the addressing, 0 if it must be set up with ibcmd.
+ * Whether we are CIC is not checked here, the addressing fails by itself
+ * when we are not and read_data/send_data report ECIC. */
+-(int) addressed_io_setup:(ibConf_t *) conf
+{
+    gpib_link *board;
+    
+    board = [self interfaceBoard:conf];
+    if( [board addressed_io] == NO )
+        return 0;
+    
+    conf->address_pending = YES;
+    return 1;
+}
+
+/* Addresses the device of conf for a read (device_talks) or a write.
+ * The command phase is skipped when the bus is still addressed that way
+ * from the previous transfer, unless IbcREADDR asks for readdressing. */
+-(int) device_io_setup:(ibConf_t *) conf : (BOOL) device_talks
+{
+    gpib_link *board;
+    int retval;
+    
+    board = [self interfaceBoard:conf];
+    
+    /* the firmware of a board addressing the device itself is then told
+     * not to address it again */
+    if( conf->settings.readdr == NO && [board is_addressed:conf->settings.pad : conf->settings.sad : device_talks] )
+        return 0;
+    
+    retval = [self addressed_io_setup:conf];
+    if( retval < 0 ) return -1;
+    if( retval > 0 ) return 0;
+    
+    conf->setup_pending = YES;
+    conf->setup_device_talks = device_talks;
+    if( device_talks )
+        retval = [self InternalReceiveSetup:conf : [self packAddress:conf->settings.pad : conf->settings.sad]];
+    else
+        retval = [self send_setup:conf];
+    conf->setup_pending = NO;
+    if( retval < 0 ) return -1;
+    
+    return 0;
 }
 
 -(int) my_ibbna:(ibConf_t *) conf : (UInt8) new_board_index
@@ -1318,24 +1409,26 @@
 -(int) ThreadIbsta
 {
     int thread_ibsta;
-    [self globals_alloc];
-    thread_ibsta = [[thread_key valueForKey:@"ibsta_key"] intValue];
+    thread_ibsta = [[[self globals_alloc] valueForKey:@"ibsta_key"] intValue];
     return thread_ibsta;
 }
 
 -(int) ThreadIberr
 {
     int thread_iberr;
-    [self globals_alloc];
-    thread_iberr = [[thread_key valueForKey:@"iberr_key"] intValue];
+    thread_iberr = [[[self globals_alloc] valueForKey:@"iberr_key"] intValue];
     return thread_iberr;
 }
 
 -(int) ThreadIbcnt
 {
-    int thread_ibcntl;
-    [self globals_alloc];
-    thread_ibcntl = [[thread_key valueForKey:@"ibcntl_key"] intValue];
+    return (int)[self ThreadIbcntl];
+}
+
+-(long) ThreadIbcntl
+{
+    long thread_ibcntl;
+    thread_ibcntl = [[[self globals_alloc] valueForKey:@"ibcntl_key"] longValue];
     return thread_ibcntl;
 }
 
@@ -1415,7 +1508,9 @@
     return 0;
 }
 
--(ssize_t) my_ibrd:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read
+/* reads with a board timeout of usec_timeout, which only applies to this
+ * call: the descriptor's timeout still bounds the addressing */
+-(ssize_t) my_ibrd:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read : (UInt32) usec_timeout
 {
     *bytes_read = 0;
     // set eos mode
@@ -1423,40 +1518,32 @@
     if( conf->is_interface == NO )
     {
         // set up addressing
-        if( [self InternalReceiveSetup:conf : [self packAddress:conf->settings.pad : conf->settings.sad]] < 0 )
+        if( [self device_io_setup:conf : YES] < 0 )
             return -1;
     }
-    return [self read_data:conf : buffer : count : bytes_read];
+    return [self read_data:conf : buffer : count : bytes_read : usec_timeout];
 }
 
--(ssize_t) read_data:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read
+-(ssize_t) read_data:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read : (UInt32) usec_timeout
 {
     gpib_link *board;
     int retval;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBRD;
+    read_write_ioctl_t read_cmd;
     
     board = [self interfaceBoard:conf];
-    /*
-    assert(sizeof(buffer) <= sizeof(arg->readWrite.buffer_ptr));
-    arg->readWrite.buffer_ptr = buffer;
-    arg->readWrite.requested_transfer_count = count;
-    arg->readWrite.completed_transfer_count = 0;
-    arg->readWrite.handle = conf->handle;
-    arg->readWrite.end = 0;*/
-    arg->read_ioctl = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
-     [NSNumber numberWithInteger:conf->handle],@"handle",
-     [[NSMutableData alloc] init],@"buffer",
-     [NSNumber numberWithInteger:count],@"requested_transfer_count",
-     [NSNumber numberWithInteger:0],@"completed_transfer_count",
-     [NSNumber numberWithBool:NO],@"end",
-     nil];
-    
-    [self set_timeout:board : conf->settings.usec_timeout];
+    read_cmd.buffer_ptr = buffer;
+    read_cmd.requested_transfer_count = count;
+    read_cmd.completed_transfer_count = 0;
+    read_cmd.handle = conf->handle;
+    read_cmd.end = NO;
+    read_cmd.address = conf->address_pending;
+    read_cmd.usec_timeout = usec_timeout;
+    conf->address_pending = NO;
+    
     conf->end = 0;
     
     //retval = ioctl( board->fileno, IBRD, &read_cmd );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBRD : &read_cmd];
     if( retval < 0 )
     {
         switch( errno )
@@ -1465,6 +1552,12 @@
                 conf->timed_out = 1;
                 [self setIberr:EABO];
                 break;
+            case EINTR:
+                [self setIberr:EABO];
+                break;
+            case EPERM:
+                [self setIberr:ECIC];
+                break;
             default:
                 [self setIberr:EDVR];
                 [self setIbcnt:errno];
@@ -1472,11 +1565,8 @@
         }
     }
     
-    //if( arg->readWrite.end ) conf->end = YES;
-    conf->end = [[arg->read_ioctl valueForKey:@"end"] boolValue];
-    //*bytes_read = arg->readWrite.completed_transfer_count;
-    *bytes_read = [[arg->read_ioctl valueForKey:@"completed_transfer_count"] intValue];
-    [[arg->read_ioctl valueForKey:@"buffer"] getBytes:buffer length:*bytes_read];
+    if( read_cmd.end ) conf->end = YES;
+    *bytes_read = read_cmd.completed_transfer_count;
     
     if(*bytes_read < count)
         buffer[*bytes_read] = '\0';
@@ -1637,6 +1727,71 @@
     return 0;
 }
 
+/* serial polls the devices of 'addressList' with a single ioctl, stopping
+ * after the first one requesting service if 'stop_on_rqs' is set.
+ * 'num_polled' returns the number of status bytes stored in 'results'. */
+-(int) serial_poll_list:(gpib_link *) board : (uint16_t *) addressList : (BOOL) stop_on_rqs : (UInt32) usec_timeout : (UInt8 *) results : (int *) num_polled
+{
+    int retval;
+    int i, num_addresses;
+    UInt16 *pads;
+    SInt16 *sads;
+    serial_poll_list_ioctl_t poll_cmd;
+    
+    *num_polled = 0;
+    num_addresses = [self numAddresses:addressList];
+    pads = calloc(num_addresses + 1, sizeof(UInt16));
+    sads = calloc(num_addresses + 1, sizeof(SInt16));
+    if( pads == NULL || sads == NULL )
+    {
+        free( pads );
+        free( sads );
+        [self setIberr:EDVR];
+        [self setIbcnt:ENOMEM];
+        return -1;
+    }
+    for( i = 0; i < num_addresses; i++ )
+    {
+        pads[ i ] = [self extractPAD:addressList[ i ]];
+        sads[ i ] = [self extractSAD:addressList[ i ]];
+    }
+    poll_cmd.pads = pads;
+    poll_cmd.sads = sads;
+    poll_cmd.results = results;
+    poll_cmd.requested_transfer_count = num_addresses;
+    poll_cmd.completed_transfer_count = 0;
+    poll_cmd.usec_timeout = usec_timeout;
+    poll_cmd.stop_on_rqs = stop_on_rqs;
+    
+    [self set_timeout:board : usec_timeout];
+    
+    retval = [board typed_ioctl:IBRSP_LIST : &poll_cmd];
+    
+    *num_polled = poll_cmd.completed_transfer_count;
+    free( pads );
+    free( sads );
+    
+    if(retval < 0)
+    {
+        switch( errno )
+        {
+            case ETIMEDOUT:
+                [self setIberr:EABO];
+                break;
+            case EPIPE:
+                [self setIberr:ESTB];
+                break;
+            default:
+                [self setIberr:EDVR];
+                [self setIbcnt:errno];
+                break;
+        }
+        return -1;
+    }
+    
+    return 0;
+}
+
 -(int) internal_ibrsv:(ibConf_t *) conf : (UInt8) status_byte
 {
     gpib_link *board;
@@ -1824,30 +1979,31 @@
     [thread cancel];
 }
 
+/* Aborts the asynchronous operation of 'conf'.  An operation still waiting
+ * for the worker is dropped, one already on the bus is cut short by the
+ * board.  Returns 1 with EABO when an operation was stopped. */
 -(int) internal_ibstop:(ibConf_t *) conf
-{    
+{
+    gpib_link *board = [self interfaceBoard:conf];
+    
     pthread_mutex_lock( &conf->async->lock );
     if( conf->async->in_progress == NO )
     {
         pthread_mutex_unlock( &conf->async->lock );
         return 0;
     }
+    conf->async->abort = 1;
+    pthread_mutex_unlock( &conf->async->lock );
     
-    if(conf->async->thread == nil)
-        return 0;
-    
-    if([conf->async->thread isExecuting] == NO)
-        return 0;
-    
-    [self performSelector:@selector(cancelThread:) onThread:conf->async->thread withObject:conf->async->thread waitUntilDone:YES];
+    /* the transfer may reach the bus only after the abort, which then
+     * forgets it when it starts, so the abort is repeated until the
+     * worker is done */
+    do
+        [board abort_io:conf->handle];
+    while( [self gpib_aio_join:conf : aio_abort_interval] == NO );
     
-    if( [conf->async->thread isCancelled] )
-    {
-        conf->async->thread = nil;
-        conf->async->in_progress = NO;
-        pthread_mutex_unlock( &conf->async->lock );
-        return 0;
-    }
+    pthread_mutex_lock( &conf->async->lock );
+    conf->async->in_progress = NO;
     pthread_mutex_unlock( &conf->async->lock );
     [self setIberr:EABO];
     
@@ -1927,10 +2083,7 @@
 {
     gpib_link *board;
     int retval;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    SInt32 arg_wait_mask = wait_mask;
-    SInt32 arg_wait_ibsta;
-    //SInt16 pad, sad;
+    wait_ioctl_t cmd;
     
     board = [self interfaceBoard:conf];
     
@@ -1940,67 +2093,49 @@
         return -1;
     }
 
-    /*arg->wait.handle = conf->handle;
-    arg->wait.usec_timeout = conf->settings.usec_timeout;
-    arg->wait.wait_mask = wait_mask;
-    arg->wait.clear_mask = clear_mask;
-    arg->wait.set_mask = set_mask;
-    arg->wait.ibsta = 0;*/
-    arg->cmd = IBWAIT;
-    //[self fixup_status_bits:conf : &arg->wait.wait_mask];
-    [self fixup_status_bits:conf : &arg_wait_mask];/*
+    cmd.handle = conf->handle;
+    cmd.usec_timeout = conf->settings.usec_timeout;
+    cmd.wait_mask = wait_mask;
+    cmd.clear_mask = clear_mask;
+    cmd.set_mask = set_mask;
+    cmd.ibsta = 0;
+    [self fixup_status_bits:conf : &cmd.wait_mask];
     if( conf->is_interface == 0 )
     {
-        //arg->wait.pad = conf->settings.pad;
-        //arg->wait.sad = conf->settings.sad;
-        pad = conf->settings.pad;
-        sad = conf->settings.sad;
+        cmd.pad = conf->settings.pad;
+        cmd.sad = conf->settings.sad;
     }else
     {
-        //arg->wait.pad = NOADDR;
-        //arg->wait.sad = NOADDR;
-        pad = NOADDR;
-        sad = NOADDR;
+        cmd.pad = NOADDR;
+        cmd.sad = NOADDR;
         //XXX additionally, clear wait mask depending on event queue enabled, etc
-    }*/
+    }
     
-    //if( wait_mask != arg->wait.wait_mask )
-    if( wait_mask != arg_wait_mask )
+    if( wait_mask != cmd.wait_mask )
     {
         [self setIberr:EARG];
         return -1;
     }
-
-    arg->read_ioctl = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
-                       [NSNumber numberWithInteger:conf->handle],@"handle",
-                       [NSNumber numberWithLong:conf->settings.usec_timeout],@"usec_timeout",
-                       [NSNumber numberWithInteger:arg_wait_mask],@"wait_mask",
-                       [NSNumber numberWithInteger:clear_mask],@"clear_mask",
-                       [NSNumber numberWithInteger:set_mask],@"set_mask",
-                       [NSNumber numberWithInteger:0],@"ibsta",
-                       //[NSNumber numberWithInteger:pad],@"pad",
-                       //[NSNumber numberWithInteger:sad],@"sad",
-                       [NSNumber numberWithInteger:IBWAIT],@"cmd",
-                       nil];
     
     //retval = ioctl(board->fileno, IBWAIT, &cmd);
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBWAIT : &cmd];
     if( retval < 0 )
     {
         [self setIberr:EDVR];
         [self setIbcnt:errno];
         return -1;
     }
-    arg_wait_ibsta = [[arg->read_ioctl valueForKey:@"ibsta"] intValue];
-    //[self fixup_status_bits:conf : &arg->wait.ibsta];
-    [self fixup_status_bits:conf : &arg_wait_ibsta];
+    [self fixup_status_bits:conf : &cmd.ibsta];
+    /* the board reports CMPL as soon as the transfer of an asynchronous
+     * operation is over, the operation completes once do_aio stored it */
+    pthread_mutex_lock( &conf->async->lock );
+    if( conf->async->in_progress && ( conf->async->ibsta & CMPL ) == 0 )
+        cmd.ibsta &= ~CMPL;
+    pthread_mutex_unlock( &conf->async->lock );
     if( conf->end ) //XXX
-        //arg->wait.ibsta |= END;
-        arg_wait_ibsta |= END;
-    //[self setIbsta:arg->wait.ibsta];
-    [self setIbsta: arg_wait_ibsta];
-    //*status = arg->wait.ibsta;
-    *status = arg_wait_ibsta;
+        cmd.ibsta |= END;
+    [self setIbsta:cmd.ibsta];
+    *status = cmd.ibsta;
     return 0;
 }
 
@@ -2042,8 +2177,8 @@
 -(int) InternalSendDataBytes:(ibConf_t *) conf : (void *) buffer : (size_t) count : (int) eotmode
 {
     int retval;
-    size_t num_bytes;
     size_t bytes_written = 0;
+    struct iovec segments[ 2 ];
     
     if( conf->is_interface == 0 )
     {
@@ -2063,39 +2198,29 @@
             break;
     }
     
-    retval = [self send_data:conf : buffer : count : eotmode == DABend : &num_bytes];
-    bytes_written += num_bytes;
+    /* the NLend newline goes out in the same transfer as the data */
+    segments[ 0 ].iov_base = buffer;
+    segments[ 0 ].iov_len = count;
+    segments[ 1 ].iov_base = "\n";
+    segments[ 1 ].iov_len = 1;
+    
+    retval = [self send_datav:conf : segments : ( eotmode == NLend ) ? 2 : 1 : eotmode != NULLend : &bytes_written : conf->settings.usec_timeout];
+    [self setIbcnt:bytes_written];
     if( retval < 0 )
-    {
-        [self setIbcnt:bytes_written];
         return retval;
-    }
-    if( eotmode == NLend )
-    {
-        retval = [self send_data:conf : "\n" : 1 : 1 : &num_bytes];
-        bytes_written += num_bytes;
-        if( retval < 0 )
-        {
-            [self setIbcnt:bytes_written];
-            return retval;
-        }
-    }
-    [self setIbcnt:bytes_written];
     return 0;
 }
 
 -(int) my_ibwrtf:(ibConf_t *) conf : (char *) file_path : (size_t *) bytes_written
 {
-    gpib_link *board;
-    long count;
+    off_t count;
     size_t block_size;
     int retval;
     FILE *data_file;
     struct stat file_stats;
-    UInt8 buffer[ 0x4000 ];
+    UInt8 *buffer;
     
     *bytes_written = 0;
-    board = [self interfaceBoard:conf];
     
     data_file = fopen( file_path, "r" );
     if( data_file == NULL )
@@ -2110,126 +2235,415 @@
     {
         [self setIberr:EFSO];
         [self setIbcnt:errno];
+        fclose( data_file );
         return -1;
     }
     
     count = file_stats.st_size;
     
+    /* a regular file goes to the bus straight from its mapping */
+    if( S_ISREG( file_stats.st_mode ) && count > 0 )
+    {
+        buffer = mmap( NULL, count, PROT_READ, MAP_PRIVATE, fileno( data_file ), 0 );
+        if( buffer != MAP_FAILED )
+        {
+            madvise( buffer, count, MADV_SEQUENTIAL );
+            retval = [self my_ibwrt:conf : buffer : count : bytes_written : conf->settings.usec_timeout];
+            munmap( buffer, count );
+            fclose( data_file );
+            return retval;
+        }
+    }
+    
     if( conf->is_interface == 0 )
     {
         // set up addressing
-        if( [self send_setup:conf] < 0 )
+        if( [self device_io_setup:conf : NO] < 0 )
         {
+            fclose( data_file );
             return -1;
         }
     }
     
-    [self set_timeout:board : conf->settings.usec_timeout];
+    buffer = malloc( GPIB_STREAM_CHUNK );
+    if( buffer == NULL )
+    {
+        [self setIberr:EDVR];
+        [self setIbcnt:ENOMEM];
+        fclose( data_file );
+        return -1;
+    }
     
-    while( count )
+    retval = 0;
+    while( count > 0 && retval == 0 )
     {
         size_t fread_count;
         int send_eoi;
         size_t buffer_offset = 0;
         
-        fread_count = fread( buffer, 1, sizeof( buffer ), data_file );
+        fread_count = fread( buffer, 1, GPIB_STREAM_CHUNK, data_file );
         if( fread_count == 0 )
         {
             [self setIberr:EFSO];
             [self setIbcnt:errno];
-            return -1;
+            retval = -1;
+            break;
         }
         while(buffer_offset < fread_count)
         {
             send_eoi = conf->settings.send_eoi && (count == fread_count - buffer_offset);
-            retval = [self send_data_smart_eoi:conf : buffer + buffer_offset : fread_count - buffer_offset : send_eoi : &block_size];
+            retval = [self send_data_smart_eoi:conf : buffer + buffer_offset : fread_count - buffer_offset : send_eoi : &block_size : conf->settings.usec_timeout];
             count -= block_size;
             buffer_offset += block_size;
             *bytes_written += block_size;
             if(retval < 0)
             {
+                retval = -1;
+                break;
+            }
+        }
+    }
+    free( buffer );
+    fclose( data_file );
+    return retval;
+}
+
+/* Reads till END into save_file.  The bus fills a ring of
+ * GPIB_STREAM_BUFFERS buffers which a serial queue writes to the file,
+ * so the disk writes overlap the following bus reads.  bytes_read is
+ * the count saved to the file. */
+-(int) read_to_file:(ibConf_t *) conf : (FILE *) save_file : (size_t *) bytes_read
+{
+    UInt8 *buffers[ GPIB_STREAM_BUFFERS ];
+    dispatch_semaphore_t free_buffers;
+    dispatch_queue_t writer;
+    atomic_int file_error;
+    atomic_int *file_error_ptr = &file_error;
+    ssize_t retval = 0;
+    int i;
+    
+    *bytes_read = 0;
+    for( i = 0; i < GPIB_STREAM_BUFFERS; i++ )
+    {
+        buffers[ i ] = malloc( GPIB_STREAM_CHUNK );
+        if( buffers[ i ] == NULL )
+        {
+            while( i-- > 0 )
+                free( buffers[ i ] );
+            [self setIberr:EDVR];
+            [self setIbcnt:ENOMEM];
+            return -1;
+        }
+    }
+    atomic_init( &file_error, 0 );
+    free_buffers = dispatch_semaphore_create( GPIB_STREAM_BUFFERS );
+    writer = dispatch_queue_create( "macosx_gpib_lib.ibrdf", DISPATCH_QUEUE_SERIAL );
+    
+    i = 0;
+    do
+    {
+        UInt8 *buffer = buffers[ i ];
+        size_t count;
+        
+        i = ( i + 1 ) % GPIB_STREAM_BUFFERS;
+        dispatch_semaphore_wait( free_buffers, DISPATCH_TIME_FOREVER );
+        retval = [self read_data:conf : buffer : GPIB_STREAM_CHUNK : &count : conf->settings.usec_timeout];
+        dispatch_async( writer, ^{
+            if( atomic_load( file_error_ptr ) == 0 )
+            {
+                if( fwrite( buffer, 1, count, save_file ) == count )
+                    *bytes_read += count;
+                else
+                    atomic_store( file_error_ptr, errno ? errno : EIO );
+            }
+            dispatch_semaphore_signal( free_buffers );
+        });
+    }while( retval >= 0 && conf->end == 0 && atomic_load( &file_error ) == 0 );
+    
+    /* wait for the queued writes */
+    dispatch_sync( writer, ^{} );
+    dispatch_release( writer );
+    dispatch_release( free_buffers );
+    for( i = 0; i < GPIB_STREAM_BUFFERS; i++ )
+        free( buffers[ i ] );
+    
+    if( atomic_load( &file_error ) )
+    {
+        [self setIberr:EFSO];
+        [self setIbcnt:atomic_load( &file_error )];
+        return -1;
+    }
+    if( retval < 0 )
+        return -1;
+    return 0;
+}
+
+/* read_data till count bytes are in or END */
+-(ssize_t) read_fully:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_read : (UInt32) usec_timeout
+{
+    size_t chunk;
+    ssize_t retval;
+    
+    *bytes_read = 0;
+    while( *bytes_read < count )
+    {
+        retval = [self read_data:conf : buffer + *bytes_read : count - *bytes_read : &chunk : usec_timeout];
+        *bytes_read += chunk;
+        if( retval < 0 )
+            return retval;
+        if( conf->end )
+            break;
+    }
+    return 0;
+}
+
+/* Reads an IEEE 488.2 arbitrary block response, '#' and a digit n then n
+ * digits giving the payload length, or "#0" for a payload ended by NL with
+ * END.  Only the header is read before the payload, which goes straight to
+ * buffer, so nothing past the block is read.  When allocated is not NULL
+ * the buffer is malloc'ed from the header and returned there instead.
+ * bytes_read is the payload stored, block_length the payload announced
+ * (for #0 the payload received).  With a caller buffer shorter than the
+ * block the read stops without END and the rest can be read with ibrd. */
+-(int) read_block:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (UInt8 **) allocated : (size_t *) bytes_read : (size_t *) block_length : (UInt32) usec_timeout
+{
+    gpib_link *board;
+    UInt8 header[ 9 ];
+    size_t length, chunk, digits, i;
+    ssize_t retval;
+    
+    *bytes_read = 0;
+    *block_length = 0;
+    if( allocated )
+        *allocated = NULL;
+    
+    board = [self interfaceBoard:conf];
+    /* the payload is binary, only END terminates it */
+    if( [self config_read_eos:board : NO : 0 : NO] < 0 )
+        return -1;
+    if( conf->is_interface == NO )
+    {
+        // set up addressing
+        if( [self device_io_setup:conf : YES] < 0 )
+            return -1;
+    }
+    
+    retval = [self read_fully:conf : header : 2 : &chunk : usec_timeout];
+    if( retval < 0 )
+        return -1;
+    if( chunk < 2 || header[ 0 ] != '#' || header[ 1 ] < '0' || header[ 1 ] > '9' )
+    {
+        [self setIberr:EDVR];
+        [self setIbcnt:EPROTO];
+        return -1;
+    }
+    digits = header[ 1 ] - '0';
+    
+    if( digits == 0 )
+    {
+        /* indefinite length, the payload runs till END */
+        if( allocated )
+        {
+            count = GPIB_BLOCK_CHUNK;
+            buffer = malloc( count );
+            if( buffer == NULL )
+            {
+                [self setIberr:EDVR];
+                [self setIbcnt:ENOMEM];
+                return -1;
+            }
+        }
+        while( conf->end == 0 )
+        {
+            if( *bytes_read == count )
+            {
+                UInt8 *larger;
+                
+                if( allocated == NULL )
+                    break;
+                larger = realloc( buffer, count * 2 );
+                if( larger == NULL )
+                {
+                    [self setIberr:EDVR];
+                    [self setIbcnt:ENOMEM];
+                    retval = -1;
+                    break;
+                }
+                buffer = larger;
+                count *= 2;
+            }
+            retval = [self read_data:conf : buffer + *bytes_read : count - *bytes_read : &chunk : usec_timeout];
+            *bytes_read += chunk;
+            if( retval < 0 )
+                break;
+        }
+        /* the NL sent with END terminates the message, it is not payload */
+        if( conf->end && *bytes_read > 0 && buffer[ *bytes_read - 1 ] == '\n' )
+            (*bytes_read)--;
+        *block_length = *bytes_read;
+    }else
+    {
+        retval = [self read_fully:conf : header : digits : &chunk : usec_timeout];
+        if( retval < 0 )
+            return -1;
+        length = 0;
+        for( i = 0; i < chunk; i++ )
+        {
+            if( header[ i ] < '0' || header[ i ] > '9' )
+                break;
+            length = length * 10 + header[ i ] - '0';
+        }
+        if( chunk < digits || i < digits || ( conf->end && length > 0 ) )
+        {
+            [self setIberr:EDVR];
+            [self setIbcnt:EPROTO];
+            return -1;
+        }
+        *block_length = length;
+        
+        if( allocated )
+        {
+            count = length;
+            buffer = malloc( length ? length : 1 );
+            if( buffer == NULL )
+            {
+                [self setIberr:EDVR];
+                [self setIbcnt:ENOMEM];
                 return -1;
             }
         }
+        if( length > 0 )
+            retval = [self read_fully:conf : buffer : MIN( length, count ) : bytes_read : usec_timeout];
+        
+        /* the payload is followed by the response message terminator, NL
+         * with END, or by the ';' or ',' separating it from the next unit.
+         * Only that byte is read, whatever comes next is left to the
+         * caller.  A talker sending neither leaves END unset */
+        if( retval >= 0 && *bytes_read == length && conf->end == 0 )
+        {
+            UInt32 terminator_timeout = GPIB_BLOCK_TERMINATOR_USEC_TIMEOUT;
+            
+            if( usec_timeout > 0 && usec_timeout < terminator_timeout )
+                terminator_timeout = usec_timeout;
+            retval = [self read_data:conf : header : 1 : &chunk : terminator_timeout];
+            if( retval < 0 && conf->timed_out )
+            {
+                conf->timed_out = 0;
+                [self setIberr:0];
+                retval = 0;
+            }
+        }
     }
+    
+    if( allocated )
+    {
+        if( retval < 0 )
+        {
+            free( buffer );
+            return -1;
+        }
+        *allocated = buffer;
+    }
+    if( retval < 0 )
+        return -1;
     return 0;
 }
 
--(int) send_data_smart_eoi:(ibConf_t *) conf : (void *) buffer : (size_t) count : (int) force_eoi : (size_t *) bytes_written
+-(int) send_data_smart_eoi:(ibConf_t *) conf : (void *) buffer : (size_t) count : (int) force_eoi : (size_t *) bytes_written : (UInt32) usec_timeout
+{
+    struct iovec segment;
+    
+    segment.iov_base = buffer;
+    segment.iov_len = count;
+    return [self send_datav_smart_eoi:conf : &segment : 1 : force_eoi : bytes_written : usec_timeout];
+}
+
+/* sends the segments up to and including the first EOS character with
+ * EOI if XEOS is set, otherwise all of them.  The segment holding the EOS
+ * is shortened for the transfer and restored afterwards */
+-(int) send_datav_smart_eoi:(ibConf_t *) conf : (struct iovec *) iov : (UInt32) iov_count : (int) force_eoi : (size_t *) bytes_written : (UInt32) usec_timeout
 {
     int eoi_on_eos;
     int eos_found = 0;
     int send_eoi;
-    unsigned long block_size;
+    UInt32 i, block_count;
+    size_t segment_length = 0;
+    ssize_t eos_index;
     int retval;
     
     eoi_on_eos = conf->settings.eos_flags & XEOS;
     
-    block_size = count;
+    block_count = iov_count;
     
     if( eoi_on_eos )
     {
-        retval = [self find_eos:buffer : count : conf->settings.eos : conf->settings.eos_flags];
-        if( retval < 0 ) eos_found = 0;
-        else
+        for( i = 0; i < iov_count; i++ )
         {
-            block_size = retval;
-            eos_found = 1;
+            eos_index = [self find_eos:iov[ i ].iov_base : iov[ i ].iov_len : conf->settings.eos : conf->settings.eos_flags];
+            if( eos_index >= 0 )
+            {
+                segment_length = iov[ i ].iov_len;
+                iov[ i ].iov_len = eos_index + 1;
+                block_count = i + 1;
+                eos_found = 1;
+                break;
+            }
         }
     }
     
     send_eoi = force_eoi || ( eoi_on_eos && eos_found );
-    if([self send_data:conf : buffer : block_size : send_eoi : bytes_written] < 0)
+    retval = [self send_datav:conf : iov : block_count : send_eoi : bytes_written : usec_timeout];
+    if( eos_found )
+        iov[ block_count - 1 ].iov_len = segment_length;
+    if( retval < 0 )
     {
         return -1;
     }
     return 0;
 }
 
--(int) find_eos:(UInt8 *) buffer : (size_t) length : (int) eos : (int) eos_flags
+-(ssize_t) find_eos:(UInt8 *) buffer : (size_t) length : (int) eos : (int) eos_flags
 {
-    UInt8 i;
-    UInt8 compare_mask;
-    
-    if( eos_flags & BIN ) compare_mask = 0xff;
-    else compare_mask = 0x7f;
-    
-    for( i = 0; i < length; i++ )
-    {
-        if( ( buffer[i] & compare_mask ) == ( eos & compare_mask ) )
-            return i;
-    }
+    return gpib_find_eos( buffer, length, eos, eos_flags & BIN );
+}
+
+-(int) send_data:(ibConf_t *)conf : (void *) buffer : (size_t) count : (BOOL) send_eoi : (size_t *) bytes_written : (UInt32) usec_timeout
+{
+    struct iovec segment;
     
-    return -1;
+    segment.iov_base = buffer;
+    segment.iov_len = count;
+    return [self send_datav:conf : &segment : 1 : send_eoi : bytes_written : usec_timeout];
 }
 
--(int) send_data:(ibConf_t *)conf : (void *) buffer : (size_t) count : (BOOL) send_eoi : (size_t *) bytes_written
+/* sends the data gathered from iov_count segments as a single transfer,
+ * EOI goes with the last byte of the last segment if send_eoi is set */
+-(int) send_datav:(ibConf_t *)conf : (const struct iovec *) iov : (UInt32) iov_count : (BOOL) send_eoi : (size_t *) bytes_written : (UInt32) usec_timeout
 {
     gpib_link *board;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBWRT;
+    read_write_ioctl_t write_cmd;
+    size_t count = 0;
+    UInt32 i;
     int retval;
     
     board = [self interfaceBoard:conf];
     
-    [self set_timeout:board : conf->settings.usec_timeout];
-    
-    /*assert(sizeof(buffer) <= sizeof(arg->readWrite.buffer_ptr));
-    arg->readWrite.buffer_ptr = buffer;
-    arg->readWrite.requested_transfer_count = count;
-    arg->readWrite.completed_transfer_count = 0;
-    arg->readWrite.end = send_eoi;
-    arg->readWrite.handle = conf->handle;*/
-    arg->read_ioctl = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
-                       [NSNumber numberWithInteger:conf->handle],@"handle",
-                       [[NSMutableData alloc] initWithBytes:buffer length:count],@"buffer",
-                       [NSNumber numberWithInteger:count],@"requested_transfer_count",
-                       [NSNumber numberWithInteger:0],@"completed_transfer_count",
-                       [NSNumber numberWithBool:send_eoi],@"send_eoi",
-                       nil];
+    for( i = 0; i < iov_count; i++ )
+        count += iov[ i ].iov_len;
+    
+    write_cmd.buffer_ptr = NULL;
+    write_cmd.iov = iov;
+    write_cmd.iov_count = iov_count;
+    write_cmd.requested_transfer_count = count;
+    write_cmd.completed_transfer_count = 0;
+    write_cmd.end = send_eoi;
+    write_cmd.handle = conf->handle;
+    write_cmd.address = conf->address_pending;
+    write_cmd.usec_timeout = usec_timeout;
+    conf->address_pending = NO;
     
     //retval = ioctl( board->fileno, IBWRT, &write_cmd);
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBWRT : &write_cmd];
     if(retval < 0)
     {
         switch( errno )
@@ -2244,6 +2658,9 @@
             case EIO:
                 [self setIberr:ENOL];
                 break;
+            case EPERM:
+                [self setIberr:ECIC];
+                break;
             case EFAULT:
                 //fall-through
             default:
@@ -2252,45 +2669,86 @@
                 break;
         }
     }
-    //*bytes_written = arg->readWrite.completed_transfer_count;
-    *bytes_written = [[arg->read_ioctl valueForKey:@"completed_transfer_count"] intValue];
+    *bytes_written = write_cmd.completed_transfer_count;
     conf->end = send_eoi && (*bytes_written == count);
     if(retval < 0) return retval;
     return 0;
 }
 
--(int) my_ibwrt:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_written
+/* writes with a board timeout of usec_timeout, see my_ibrd */
+-(int) my_ibwrt:(ibConf_t *) conf : (UInt8 *) buffer : (size_t) count : (size_t *) bytes_written : (UInt32) usec_timeout
 {
-    gpib_link *board;
+    struct iovec segment;
+    
+    segment.iov_base = buffer;
+    segment.iov_len = count;
+    return [self my_ibwrtv:conf : &segment : 1 : bytes_written : usec_timeout];
+}
+
+/* writes the data gathered from iov_count segments as a single message,
+ * EOI and the XEOS handling only apply to the data as a whole */
+-(int) my_ibwrtv:(ibConf_t *) conf : (const struct iovec *) iov : (UInt32) iov_count : (size_t *) bytes_written : (UInt32) usec_timeout
+{
+    struct iovec local_segments[ GPIB_LINK_WRITE_SEGMENTS ];
+    struct iovec *segments;
+    UInt32 first;
     size_t block_size;
-    int retval;
+    int retval = 0;
     
     *bytes_written = 0;
-    board = [self interfaceBoard:conf];
-    
-    [self set_timeout:board : conf->settings.usec_timeout];
     
     if( conf->is_interface == 0 )
     {
         // set up addressing
-        if( [self send_setup:conf] < 0 )
+        if( [self device_io_setup:conf : NO] < 0 )
+            return -1;
+    }
+    
+    /* the segments are consumed as the data goes out */
+    if( iov_count <= GPIB_LINK_WRITE_SEGMENTS )
+        segments = local_segments;
+    else
+    {
+        segments = malloc( iov_count * sizeof( struct iovec ) );
+        if( segments == NULL )
         {
+            [self setIberr:EDVR];
+            [self setIbcnt:ENOMEM];
             return -1;
         }
     }
+    memcpy( segments, iov, iov_count * sizeof( struct iovec ) );
     
-    while( count )
+    first = 0;
+    while( first < iov_count )
     {
-        retval = [self send_data_smart_eoi:conf : buffer : count : conf->settings.send_eoi : &block_size];
+        if( segments[ first ].iov_len == 0 )
+        {
+            first++;
+            continue;
+        }
+        retval = [self send_datav_smart_eoi:conf : segments + first : iov_count - first : conf->settings.send_eoi : &block_size : usec_timeout];
         *bytes_written += block_size;
-        if(retval < 0)
+        if( retval < 0 )
+            break;
+        while( block_size > 0 )
         {
-            return -1;
+            if( block_size >= segments[ first ].iov_len )
+            {
+                block_size -= segments[ first ].iov_len;
+                first++;
+            }else
+            {
+                segments[ first ].iov_base = ( UInt8 * ) segments[ first ].iov_base + block_size;
+                segments[ first ].iov_len -= block_size;
+                block_size = 0;
+            }
         }
-        count -= block_size;
-        buffer += block_size;
     }
-    return 0;
+    
+    if( segments != local_segments )
+        free( segments );
+    return retval;
 }
 
 -(int) extractPAD:(uint16_t) address
@@ -2355,11 +2813,8 @@
 
 -(int) set_timeout:(gpib_link *) board : (UInt32) usec_timeout
 {
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBTMO;
-    arg->nUsecDuration = usec_timeout;
     //return ioctl( board->fileno, IBTMO, &usec_timeout);
-    return [board ioctl:arg];
+    return [board typed_ioctl:IBTMO : &usec_timeout];
 }
 
 -(UInt8) numAddresses:(uint16_t *) addressList
@@ -2381,30 +2836,18 @@
 -(BOOL) is_cic:(gpib_link *) board
 {
     int retval;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    /*arg->wait.usec_timeout = 0;
-    arg->wait.wait_mask = 0;
-    arg->wait.clear_mask = 0;
-    arg->wait.set_mask = 0;
-    arg->wait.pad = NOADDR;
-    arg->wait.sad = NOADDR;
-    arg->wait.handle = 0;
-    arg->wait.ibsta = 0;*/
-    arg->cmd = IBWAIT;
-
-    arg->read_ioctl = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
-                       [NSNumber numberWithInteger:0],@"handle",
-                       [NSNumber numberWithLong:0],@"usec_timeout",
-                       [NSNumber numberWithInteger:0],@"wait_mask",
-                       [NSNumber numberWithInteger:0],@"clear_mask",
-                       [NSNumber numberWithInteger:0],@"set_mask",
-                       [NSNumber numberWithInteger:0],@"ibsta",
-                       //[NSNumber numberWithInteger:NOADDR],@"pad",
-                       //[NSNumber numberWithInteger:NOADDR],@"sad",
-                       [NSNumber numberWithInteger:IBWAIT],@"cmd",
-                       nil];
+    wait_ioctl_t cmd;
+    
+    cmd.usec_timeout = 0;
+    cmd.wait_mask = 0;
+    cmd.clear_mask = 0;
+    cmd.set_mask = 0;
+    cmd.pad = NOADDR;
+    cmd.sad = NOADDR;
+    cmd.handle = 0;
+    cmd.ibsta = 0;
     //retval = ioctl( board->fileno, IBWAIT, &cmd );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBWAIT : &cmd];
     if( retval < 0 )
     {
         [self setIberr:EDVR];
@@ -2413,8 +2856,7 @@
         return -1;
     }
     
-    //if( arg->wait.ibsta & CIC )
-    if([[arg->read_ioctl valueForKey:@"ibsta"] intValue] & CIC)
+    if( cmd.ibsta & CIC )
         return YES;
     
     return NO;
@@ -2423,19 +2865,16 @@
 -(int) is_system_controller:(gpib_link *) board
 {
     int retval;
-    //board_info_ioctl_t info;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBBOARD_INFO;
+    board_info_ioctl_t info;
     
-    //retval = ioctl( board->fileno, IBBOARD_INFO, &info );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBBOARD_INFO : &info];
     if( retval < 0 )
     {
         fprintf( stderr, "libmacosx_gpib: error in is_system_controller()!\n");
         return retval;
     }
     
-    return arg->boardInfo.is_system_controller;
+    return info.is_system_controller;
 }
 
 -(int) InternalRcvRespMsg:(ibConf_t *) conf : (void *) buffer : (long) count : (int) termination
@@ -2475,7 +2914,7 @@
         return retval;
     }
     
-    retval = (int)[self read_data:conf : buffer : count : &bytes_read];
+    retval = (int)[self read_data:conf : buffer : count : &bytes_read : conf->settings.usec_timeout];
     [self setIbcnt:bytes_read];
     if(retval < 0)
     {
@@ -2702,12 +3141,10 @@
 -(int) lock_board_mutex:(gpib_link *) board
 {
     int retval;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBMUTEX;
-    arg->bMutex = YES;
+    BOOL lock = YES;
     
     //retval = ioctl( board->fileno, IBMUTEX, &lock );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBMUTEX : &lock];
     if( retval < 0 )
     {
         fprintf( stderr, "libmacosx_gpib: error locking board mutex!\n");
@@ -2721,11 +3158,9 @@
 -(int) unlock_board_mutex:(gpib_link *) board
 {
     int retval;
-    gpib_link_arg* arg = [[gpib_link_arg alloc] init];
-    arg->cmd = IBMUTEX;
-    arg->bMutex = NO;
+    BOOL unlock = NO;
     //retval = ioctl( board->fileno, IBMUTEX, &unlock );
-    retval = [board ioctl:arg];
+    retval = [board typed_ioctl:IBMUTEX : &unlock];
     if( retval < 0 )
     {
         fprintf( stderr, "libmacosx_gpib: error unlocking board mutex!\n");
@@ -2775,59 +3210,78 @@
 {
     size_t count = 0;
     ibConf_t *conf = arg->conf;
+    async_operation *async = conf->async;
     int retval = 0;
-    //gpib_link *board = [self interfaceBoard:arg->conf];
-    //retval = [self lock_board_mutex:board];
-    if(retval == 0)
-    {
-        retval = (int)[self ibstatus:conf : 0 : CMPL : 0];
-    }
+    gpib_aio_callback_t callback;
+    void *callback_data;
+    int status, error;
+    long cnt;
     
-    if( retval < 0 ) return;
-    
-    if (![[NSThread currentThread]  isCancelled]) {
+    [self setIberr:0];
+    [self setIbcnt:0];
+    if( async->abort == 0 )
+    {
         switch( arg->gpib_aio_type )
         {
             case GPIB_AIO_COMMAND:
-                retval = (int)[self my_ibcmd:conf : conf->async->buffer : conf->async->buffer_length];
+                retval = (int)[self my_ibcmd:conf : async->buffer : async->buffer_length];
                 break;
             case GPIB_AIO_READ:
-                retval = (int)[self my_ibrd:conf : conf->async->buffer : conf->async->buffer_length : &count];
+                retval = (int)[self my_ibrd:conf : async->buffer : async->buffer_length : &count : conf->settings.usec_timeout];
                 break;
             case GPIB_AIO_WRITE:
-                retval = (int)[self my_ibwrt:conf : conf->async->buffer : conf->async->buffer_length : &count];
+                retval = (int)[self my_ibwrt:conf : async->buffer : async->buffer_length : &count : conf->settings.usec_timeout];
                 break;
             default:
                 retval = -1;
                 fprintf( stderr, "libmacosx_gpib: bug! in %s\n", __FUNCTION__ );
                 break;
         }
+    }else
+    {
+        retval = -1;
+        [self setIberr:EABO];
     }
 
+    pthread_mutex_lock( &async->lock );
     if(retval < 0)
     {
         if([self ThreadIberr] != EDVR)
-            conf->async->ibcntl = count;
+            async->ibcntl = count;
         else
-            conf->async->ibcntl = [self ThreadIbcnt];
-        conf->async->iberr = [self ThreadIberr];
-        conf->async->ibsta = CMPL | ERR;
+            async->ibcntl = [self ThreadIbcntl];
+        async->iberr = [self ThreadIberr];
+        async->ibsta = CMPL | ERR;
     }else
     {
-        conf->async->ibcntl = count;
-        conf->async->iberr = 0;
-        conf->async->ibsta = CMPL;
+        async->ibcntl = count;
+        async->iberr = 0;
+        async->ibsta = CMPL;
     }
-    //arg->condition_flag = YES;
-    [self ibstatus:arg->conf : 0 : 0 : CMPL];
-    //[self unlock_board_mutex:board];
-    [[NSThread currentThread] cancel];
+    callback = async->callback;
+    callback_data = async->callback_data;
+    error = async->iberr;
+    cnt = async->ibcntl;
+    pthread_mutex_unlock( &async->lock );
+    atomic_fetch_sub( &aio_pending[ conf->settings.board ], 1 );
+    
+    status = [self ibstatus:conf : retval < 0 : 0 : CMPL];
+    
+    [async->condition lock];
+    [async->condition broadcast];
+    [async->condition unlock];
+    gpib_signal_event( [[self interfaceBoard:conf] private_board] );
+    
+    if( callback )
+        callback( arg->ud, status, error, cnt, callback_data );
 }
 
 -(void) gpib_visa_asynch_thread//:(NSCondition*) condition
 {
     @autoreleasepool {
         NSRunLoop *runLoop = [NSRunLoop currentRunLoop];
+        /* without an input source the run loop returns at once */
+        [runLoop addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
         while ([[NSThread currentThread] isCancelled]==NO)
         {
             [runLoop runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]]; // starting infinite loop which can be stopped by changing the shouldKeepRunning's value
@@ -2836,16 +3290,43 @@
     [NSThread exit];
 }
 
+/* thread running the asynchronous operations of the board of 'conf',
+ * started with the first one and kept for the following ones */
+-(NSThread *) gpib_aio_worker:(ibConf_t *) conf
+{
+    NSNumber *key = [NSNumber numberWithInt:conf->settings.board];
+    NSThread *worker;
+    
+    pthread_mutex_lock( &aio_workers_lock );
+    worker = [aio_workers objectForKey:key];
+    if( worker == nil )
+    {
+        worker = [[NSThread alloc] initWithTarget:self selector:@selector(gpib_visa_asynch_thread) object:nil];
+        [worker setName:[NSString stringWithFormat:@"gpib aio %d", conf->settings.board]];
+        [worker start];
+        while([worker isExecuting]==NO);
+        [aio_workers setObject:worker forKey:key];
+    }
+    pthread_mutex_unlock( &aio_workers_lock );
+    
+    return worker;
+}
+
+/* Queues the operation on the board worker and returns at once, CMPL
+ * is cleared until the operation completes.  Fails with EOIP while the
+ * previous one of 'conf' was not waited for */
 -(int) gpib_aio_launch:(int) ud : (ibConf_t *) conf : (int) gpib_aio_type : (void *) buffer : (long) cnt        
 {
     int retval = 0;
-    gpib_aio_arg *arg = [[gpib_aio_arg alloc] init];
-    arg->ud = ud;
-    arg->conf = conf;
-    arg->gpib_aio_type = gpib_aio_type;
-    arg->count = 0;
+    gpib_aio_arg *arg;
     
     pthread_mutex_lock( &conf->async->lock );
+    if( conf->async->in_progress )
+    {
+        pthread_mutex_unlock( &conf->async->lock );
+        [self setIberr:EOIP];
+        return -1;
+    }
     conf->async->in_progress = YES;
     conf->async->ibsta = 0;
     conf->async->ibcntl = 0;
@@ -2853,25 +3334,62 @@
     conf->async->buffer = buffer;
     conf->async->buffer_length = cnt;
     conf->async->abort = 0;
-    conf->async->thread = [[NSThread alloc] initWithTarget:self selector:@selector(gpib_visa_asynch_thread) object:nil];
-
-    [conf->async->thread start];
-
-    while([conf->async->thread isExecuting]==NO);
-
-    [self performSelector:@selector(do_aio:) onThread:conf->async->thread withObject:arg waitUntilDone:YES];
-    
-    conf->async->thread = nil;
-    conf->async->in_progress = NO;
     pthread_mutex_unlock( &conf->async->lock );
-
-    if( retval )
+    
+    retval = [self ibstatus:conf : 0 : CMPL : 0];
+    if( retval & ERR )
     {
-        [self setIberr:EDVR];
-        [self setIbcnt:retval];
+        pthread_mutex_lock( &conf->async->lock );
+        conf->async->in_progress = NO;
+        pthread_mutex_unlock( &conf->async->lock );
         return -1;
     }
     
+    arg = [[gpib_aio_arg alloc] init];
+    arg->ud = ud;
+    arg->conf = conf;
+    arg->gpib_aio_type = gpib_aio_type;
+    arg->count = 0;
+    conf->async->thread = [self gpib_aio_worker:conf];
+    atomic_fetch_add( &aio_pending[ conf->settings.board ], 1 );
+    [self performSelector:@selector(do_aio:) onThread:conf->async->thread withObject:arg waitUntilDone:NO];
+    
+    return 0;
+}
+
+/* waits up to 'timeout' seconds for do_aio to be done with the operation
+ * of 'conf', returns NO if it is not */
+-(BOOL) gpib_aio_join:(ibConf_t *) conf : (NSTimeInterval) timeout
+{
+    NSDate *limit = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    BOOL complete;
+    
+    [conf->async->condition lock];
+    while( ( conf->async->ibsta & CMPL ) == 0 )
+        if( [conf->async->condition waitUntilDate:limit] == NO )
+            break;
+    complete = ( conf->async->ibsta & CMPL ) != 0;
+    [conf->async->condition unlock];
+    
+    return complete;
+}
+
+/* YES while the board of 'ud' has an asynchronous operation of any of its
+ * descriptors to complete */
+-(BOOL) gpib_aio_board_busy:(int) ud
+{
+    if( ud < 0 || ud >= GPIB_CONFIGS_LENGTH || ibConfigs[ ud ] == nil )
+        return NO;
+    return atomic_load( &aio_pending[ ibConfigs[ ud ]->settings.board ] ) > 0;
+}
+
+-(int) internal_ibaionotify:(ibConf_t *) conf : (gpib_aio_callback_t) callback : (void *) data
+{
+    pthread_mutex_lock( &conf->async->lock );
+    conf->async->callback = callback;
+    conf->async->callback_data = data;
+    pthread_mutex_unlock( &conf->async->lock );
+    
     return 0;
 }
 
@@ -2968,7 +3486,7 @@
 {
     ibsta = [self ThreadIbsta];
     iberr = [self ThreadIberr];
-    ibcntl = [self ThreadIbcnt];
+    ibcntl = [self ThreadIbcntl];
     ibcnt = (int)ibcntl;
 }
 
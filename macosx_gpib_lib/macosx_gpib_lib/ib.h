@@ -23,6 +23,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <sys/uio.h>
 #include "gpib_user.h"
 
 typedef uint16_t Addr4882_t;
@@ -91,6 +92,7 @@ extern long AsyncIbcntl( void );
 extern void Trigger( int board_desc, Addr4882_t address );
 extern void TriggerList( int board_desc, const Addr4882_t addressList[] );
 extern void WaitSRQ( int board_desc, short *result );
+extern int ibaionotify( int ud, gpib_aio_callback_t callback, void *data );
 extern int ibask( int ud, int option, int *value );
 extern int ibbna( int ud, char *board_name );
 extern int ibcac( int ud, int synchronous );
@@ -115,7 +117,10 @@ extern int ibpct( int ud );
 extern int ibppc( int ud, int v );
 extern int ibrd( int ud, void *buf, long count );
 extern int ibrda( int ud, void *buf, long count );
+extern int ibrdblock( int ud, void *buf, long count, long *block_length );
+extern int ibrdblockalloc( int ud, void **block, long *block_length );
 extern int ibrdf( int ud, const char *file_path );
+extern int ibrdtmo( int ud, void *buf, long count, unsigned int usec_timeout );
 extern int ibrpp( int ud, char *ppr );
 extern int ibrsc( int ud, int v );
 extern int ibrsp( int ud, char *spr );
@@ -129,9 +134,12 @@ extern int ibtmo( int ud, int v );
 extern int ibtrg( int ud );
 extern void ibvers( char **version);
 extern int ibwait( int ud, int mask );
+extern int ibwaitany( const int ud_list[], const int mask_list[], int count, int *index );
 extern int ibwrt( int ud, const void *buf, long count );
 extern int ibwrta( int ud, const void *buf, long count );
 extern int ibwrtf( int ud, const char *file_path );
+extern int ibwrttmo( int ud, const void *buf, long count, unsigned int usec_timeout );
+extern int ibwrtv( int ud, const struct iovec *iov, int count );
 extern const char* gpib_error_string( int iberr );
 
 static __inline__ Addr4882_t MakeAddr( unsigned int pad, unsigned int sad )
@@ -43,6 +43,8 @@
 	volatile long ibcntl;
 	volatile BOOL in_progress;
 	volatile short abort;
+	gpib_aio_callback_t callback;	/* called when an operation completes */
+	void *callback_data;
 }
 @end;
 
@@ -60,7 +62,7 @@ typedef struct
 	BOOL send_eoi : YES;	/* assert EOI at end of writes */
 	BOOL local_lockout : YES;	/* send local lockout when device is brought online */
 	BOOL local_ppc : YES;	/* enable local configuration of board's parallel poll response */
-	BOOL readdr : YES;	/* useless, exists for compatibility only at present */
+	BOOL readdr : YES;	/* address the device before every read and write */
 }descriptor_settings_t;
 
 @interface ibConf_t : NSObject{
@@ -77,6 +79,9 @@ typedef struct
 	BOOL board_is_open : YES;
 	BOOL has_lock : YES;
 	BOOL timed_out : YES;		/* io operation timed out */
+	BOOL address_pending : YES;	/* board addresses the device with the next read/write */
+	BOOL setup_pending : YES;	/* the next ibcmd addresses the device, see device_io_setup() */
+	BOOL setup_device_talks : YES;	/* ... as talker, else as listener */
 }
 @end;
 